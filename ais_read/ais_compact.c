@@ -0,0 +1,331 @@
+/*
+ * Compact a day's worth of hourly logs into a columnar archive, or
+ * scan the positions out of an archive.
+ */
+#include <stdio.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#include "ais.h"
+#include "ais_pool.h"
+#include "ais_archive.h"
+#include "ais_simplify.h"
+
+#define MAXLINELEN			512
+
+struct ais_arec	*recs;
+int				nrecs;
+int				maxrecs;
+char			*names;
+int				names_len;
+int				names_max;
+int				cur_time;
+int				simplifying;
+struct ais_simplify	simp;
+
+void	compact(char *, char *);
+void	scan(char *, int, int, int *, unsigned int, int);
+void	add_record(void *, struct ais_msg *, struct ais_record *);
+void	add_point(void *, unsigned int, struct ais_spoint *);
+struct ais_arec	*new_record();
+void	usage();
+
+/*
+ *
+ */
+int
+main(int argc, char *argv[])
+{
+	int i, scanning, verbose, tfrom, tto, box[4], *boxp;
+	unsigned int mmsi;
+	char *outfile;
+	double tolerance;
+
+	opterr = 0;
+	scanning = verbose = 0;
+	outfile = NULL;
+	tfrom = 0;
+	tto = 86400;
+	boxp = NULL;
+	mmsi = 0;
+	tolerance = 0.0;
+	while ((i = getopt(argc, argv, "o:st:b:m:vT:")) != EOF) {
+		switch (i) {
+		case 'o':
+			outfile = optarg;
+			break;
+
+		case 's':
+			scanning = 1;
+			break;
+
+		case 't':
+			if (sscanf(optarg, "%d-%d", &tfrom, &tto) != 2)
+				usage();
+			tfrom *= 3600;
+			tto *= 3600;
+			break;
+
+		case 'b':
+			{
+				double lat1, lon1, lat2, lon2;
+
+				if (sscanf(optarg, "%lf,%lf,%lf,%lf", &lat1, &lon1, &lat2, &lon2) != 4)
+					usage();
+				box[0] = lat1 * 600000.0;
+				box[1] = lon1 * 600000.0;
+				box[2] = lat2 * 600000.0;
+				box[3] = lon2 * 600000.0;
+				boxp = box;
+			}
+			break;
+
+		case 'm':
+			mmsi = strtoul(optarg, NULL, 10);
+			break;
+
+		case 'v':
+			verbose = 1;
+			break;
+
+		case 'T':
+			if ((tolerance = atof(optarg)) <= 0.0)
+				usage();
+			simplifying = 1;
+			break;
+
+		default:
+			usage();
+			break;
+		}
+	}
+	if (optind != argc - 1)
+		usage();
+	if (simplifying)
+		ais_simp_init(&simp, AIS_SIMP_WINDOW, tolerance, AIS_SIMP_MAXGAP, add_point, NULL);
+	if (scanning)
+		scan(argv[optind], tfrom, tto, boxp, mmsi, verbose);
+	else
+		compact(argv[optind], outfile);
+	exit(0);
+}
+
+/*
+ * Read all of the hourly logs in a day directory, and write them out
+ * as an archive.
+ */
+void
+compact(char *daydir, char *outfile)
+{
+	int hour, day, logsecs;
+	char *cp, fpath[MAXLINELEN], line[MAXLINELEN], sentence[MAXLINELEN + 8];
+	FILE *fp;
+	struct nmea_parser parser;
+	struct stat stbuf;
+
+	while ((cp = strrchr(daydir, '/')) != NULL && cp[1] == '\0')
+		*cp = '\0';
+	cp = (cp = strrchr(daydir, '/')) != NULL ? cp + 1 : daydir;
+	if (strlen(cp) != 8 || (day = atoi(cp)) < 19700101) {
+		fprintf(stderr, "?Error - '%s' is not a YYYYMMDD directory.\n", daydir);
+		exit(2);
+	}
+	if (outfile == NULL) {
+		snprintf(fpath, sizeof(fpath), "%s.aisc", daydir);
+		outfile = strdup(fpath);
+	}
+	nmea_init(&parser, NULL, add_record, NULL);
+	for (hour = 0; hour < 24; hour++) {
+		snprintf(fpath, sizeof(fpath), "%s/ais%02d.log", daydir, hour);
+		if ((fp = fopen(fpath, "r")) == NULL)
+			continue;
+		while (fgets(line, sizeof(line), fp) != NULL) {
+			if ((logsecs = nmea_logline(line, sentence, sizeof(sentence))) < 0)
+				continue;
+			cur_time = logsecs;
+			nmea_sentence(&parser, sentence);
+		}
+		fclose(fp);
+		if (simplifying)
+			ais_simp_expire(&simp, (hour + 1) * 3600);
+	}
+	if (simplifying)
+		ais_simp_flush(&simp);
+	printf("%s: %lu lines, %lu messages, %d records.\n", daydir,
+				parser.nlines, parser.nmessages, nrecs);
+	if (simplifying)
+		printf("Simplified %lu positions down to %lu (%.1f%%).\n",
+					simp.npoints_in, simp.npoints_out,
+					simp.npoints_in > 0 ? simp.npoints_out * 100.0 / simp.npoints_in : 0.0);
+	if (ais_arc_write(outfile, day, recs, nrecs, names) < 0) {
+		perror(outfile);
+		exit(1);
+	}
+	if (stat(outfile, &stbuf) == 0)
+		printf("Wrote %s (%ld bytes, %.1f bytes/record).\n", outfile,
+					(long )stbuf.st_size, nrecs > 0 ? (double )stbuf.st_size / nrecs : 0.0);
+}
+
+/*
+ * Add a decoded message to the list of records. Positions go through
+ * the simplifier first, if there is one.
+ */
+void
+add_record(void *arg, struct ais_msg *ap, struct ais_record *rp)
+{
+	int len;
+	struct ais_arec *arp;
+	struct ais_spoint pt;
+
+	if (simplifying && ais_simp_wanted(rp->type) && (rp->flags & AIS_HAS_POSITION)) {
+		pt.time = cur_time;
+		pt.lat = rp->lat;
+		pt.lon = rp->lon;
+		pt.sog = rp->sog;
+		pt.cog = rp->cog;
+		pt.heading = rp->heading;
+		pt.type = rp->type;
+		pt.nav_status = rp->nav_status;
+		ais_simp_add(&simp, rp->mmsi, &pt);
+		return;
+	}
+	arp = new_record();
+	arp->mmsi = rp->mmsi;
+	arp->time = cur_time;
+	arp->lat = rp->lat;
+	arp->lon = rp->lon;
+	arp->sog = rp->sog;
+	arp->cog = rp->cog;
+	arp->heading = rp->heading;
+	arp->type = rp->type;
+	arp->nav_status = rp->nav_status;
+	arp->shiptype = rp->shiptype;
+	arp->name = -1;
+	if ((len = strlen(rp->name)) > 0) {
+		if (names_len + len + 1 > names_max) {
+			names_max = names_max == 0 ? 65536 : names_max * 2;
+			if ((names = realloc(names, names_max)) == NULL) {
+				perror("ais_compact: realloc");
+				exit(1);
+			}
+		}
+		strcpy(names + names_len, rp->name);
+		arp->name = names_len;
+		names_len += len + 1;
+	}
+}
+
+/*
+ * Add a position which made it through the simplifier.
+ */
+void
+add_point(void *arg, unsigned int mmsi, struct ais_spoint *pp)
+{
+	struct ais_arec *arp;
+
+	arp = new_record();
+	arp->mmsi = mmsi;
+	arp->time = pp->time;
+	arp->lat = pp->lat;
+	arp->lon = pp->lon;
+	arp->sog = pp->sog;
+	arp->cog = pp->cog;
+	arp->heading = pp->heading;
+	arp->type = pp->type;
+	arp->nav_status = pp->nav_status;
+	arp->shiptype = 0;
+	arp->name = -1;
+}
+
+/*
+ * Grab the next free record, growing the list as needed.
+ */
+struct ais_arec *
+new_record()
+{
+	if (nrecs == maxrecs) {
+		maxrecs = maxrecs == 0 ? 65536 : maxrecs * 2;
+		if ((recs = realloc(recs, maxrecs * sizeof(*recs))) == NULL) {
+			perror("ais_compact: realloc");
+			exit(1);
+		}
+	}
+	return(&recs[nrecs++]);
+}
+
+/*
+ * Scan the position reports out of an archive. Only the position
+ * blocks which could match are looked at, and only the MMSI, time and
+ * position columns are read.
+ */
+void
+scan(char *file, int tfrom, int tto, int *box, unsigned int mmsi, int verbose)
+{
+	int i, j, nmatch, *mmsis, *times, *lats, *lons;
+	struct ais_archive *ap;
+	struct ais_ablock *bp;
+	struct ais_arena arena;
+	struct stat stbuf;
+
+	if ((ap = ais_arc_open(file)) == NULL || fstat(ap->fd, &stbuf) < 0) {
+		perror(file);
+		exit(1);
+	}
+	ais_arena_init(&arena, 4 * AIS_ARC_BLOCKSIZE * sizeof(int));
+	mmsis = ais_arena_alloc(&arena, AIS_ARC_BLOCKSIZE * sizeof(int));
+	times = ais_arena_alloc(&arena, AIS_ARC_BLOCKSIZE * sizeof(int));
+	lats = ais_arena_alloc(&arena, AIS_ARC_BLOCKSIZE * sizeof(int));
+	lons = ais_arena_alloc(&arena, AIS_ARC_BLOCKSIZE * sizeof(int));
+	if (mmsis == NULL || times == NULL || lats == NULL || lons == NULL) {
+		perror("ais_compact: malloc");
+		exit(1);
+	}
+	for (i = nmatch = 0; i < ap->nblocks; i++) {
+		bp = &ap->blocks[i];
+		if (bp->group != AIS_GRP_POSITION || bp->tmax < tfrom || bp->tmin >= tto)
+			continue;
+		if (mmsi != 0 && (mmsi < bp->mmsimin || mmsi > bp->mmsimax))
+			continue;
+		if (box != NULL && (bp->latmax < box[0] || bp->latmin > box[2] ||
+								bp->lonmax < box[1] || bp->lonmin > box[3]))
+			continue;
+		if (ais_arc_column(ap, bp, AIS_COL_MMSI, mmsis, NULL) < 0 ||
+					ais_arc_column(ap, bp, AIS_COL_TIME, times, mmsis) < 0 ||
+					ais_arc_column(ap, bp, AIS_COL_LAT, lats, mmsis) < 0 ||
+					ais_arc_column(ap, bp, AIS_COL_LON, lons, mmsis) < 0) {
+			fprintf(stderr, "?Error - corrupt block %d in %s.\n", i, file);
+			continue;
+		}
+		for (j = 0; j < bp->nrecs; j++) {
+			if (times[j] < tfrom || times[j] >= tto || lats[j] == AIS_LAT_NA ||
+						(mmsi != 0 && mmsis[j] != mmsi))
+				continue;
+			if (box != NULL && (lats[j] < box[0] || lats[j] > box[2] ||
+								lons[j] < box[1] || lons[j] > box[3]))
+				continue;
+			nmatch++;
+			if (verbose)
+				printf("%02d:%02d:%02d %09u %.5f %.5f\n", times[j] / 3600,
+							(times[j] / 60) % 60, times[j] % 60, mmsis[j],
+							lats[j] / 600000.0, lons[j] / 600000.0);
+		}
+	}
+	printf("%d positions from %d records. Read %llu of %ld bytes (%.1f%%).\n",
+				nmatch, ap->nrecs, ap->bytes_read, (long )stbuf.st_size,
+				stbuf.st_size > 0 ? ap->bytes_read * 100.0 / stbuf.st_size : 0.0);
+	ais_arena_free(&arena);
+	ais_arc_close(ap);
+}
+
+/*
+ *
+ */
+void
+usage()
+{
+	fprintf(stderr, "Usage: ais_compact [-o <outfile>] [-T <metres>] <datadir>/<YYYYMMDD>\n");
+	fprintf(stderr, "       ais_compact -s [-t <hour>-<hour>] [-b <lat1>,<lon1>,<lat2>,<lon2>] [-m <mmsi>] [-v] <file>\n");
+	exit(2);
+}
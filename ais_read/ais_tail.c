@@ -0,0 +1,83 @@
+/*
+ * Follow a shared-memory AIS ring, printing each entry. This is also
+ * the simplest example of a local consumer.
+ */
+#include <stdio.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ais.h"
+#include "ais_ring.h"
+
+/*
+ *
+ */
+int
+main(int argc, char *argv[])
+{
+	int len, kind, from_oldest;
+	long long stamp;
+	unsigned long nlost;
+	char buffer[AIS_RING_DATASIZE + 1];
+	struct ais_ring *rp;
+	struct ais_ring_reader reader;
+	struct ais_record rec;
+
+	from_oldest = 0;
+	if (argc == 3 && strcmp(argv[1], "-a") == 0) {
+		from_oldest = 1;
+		argc--;
+		argv++;
+	}
+	if (argc != 2) {
+		fprintf(stderr, "ais_tail [-a] <shmname>\n");
+		exit(2);
+	}
+	if ((rp = ais_ring_attach(argv[1])) == NULL) {
+		perror(argv[1]);
+		exit(1);
+	}
+	ais_ring_reader(rp, &reader, from_oldest);
+	for (nlost = 0;;) {
+		if ((len = ais_ring_get(&reader, &kind, buffer, AIS_RING_DATASIZE, &stamp)) == 0) {
+			ais_ring_wait(&reader, 1000);
+			continue;
+		}
+		if (len == AIS_RING_CLOSED) {
+			/*
+			 * The producer has gone (or been restarted). Wait
+			 * for a new ring, and read it from the start.
+			 */
+			printf("?Ring closed, waiting for it to reopen.\n");
+			fflush(stdout);
+			ais_ring_close(rp);
+			while ((rp = ais_ring_attach(argv[1])) == NULL)
+				sleep(1);
+			ais_ring_reader(rp, &reader, 1);
+			nlost = 0;
+			continue;
+		}
+		if (reader.nlost != nlost) {
+			printf("?Lost %lu entries.\n", reader.nlost - nlost);
+			nlost = reader.nlost;
+		}
+		if (len < 0)
+			continue;
+		printf("%lld.%06lld: ", stamp / 1000000, stamp % 1000000);
+		if (kind == AIS_RING_SENTENCE) {
+			buffer[len] = '\0';
+			printf("%s\n", buffer);
+		} else if (kind == AIS_RING_RECORD && len == sizeof(struct ais_record)) {
+			/*
+			 * The buffer isn't aligned for a record, so copy it out.
+			 */
+			memcpy(&rec, buffer, sizeof(rec));
+			printf("TYPE:%d MMSI:%09u", rec.type, rec.mmsi);
+			if (rec.flags & AIS_HAS_POSITION)
+				printf(" POS:%.5f,%.5f", rec.lat / 600000.0, rec.lon / 600000.0);
+			putchar('\n');
+		}
+		fflush(stdout);
+	}
+}
@@ -0,0 +1,168 @@
+/*
+ * Benchmark the CPA/TCPA engine on synthetic traffic. A number of
+ * vessels are scattered around a handful of busy areas, and each one
+ * reports every few seconds, staggered, just as a live feed would.
+ * We time how long each second of traffic takes to process.
+ */
+#include <stdio.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <math.h>
+
+#include "ais.h"
+#include "ais_pool.h"
+#include "ais_cpa.h"
+
+struct sim_vessel {
+	unsigned int	mmsi;
+	double			lat;
+	double			lon;
+	int				sog;
+	int				cog;
+};
+
+struct ais_cpa		cpa;
+struct sim_vessel	*fleet;
+
+double	elapsed(struct timespec *);
+void	usage();
+
+/*
+ *
+ */
+int
+main(int argc, char *argv[])
+{
+	int i, t, nvessels, nsecs, interval, nzones, zone, verbose, zcog[64];
+	double secs, total, worst, d, r, a, zlat[64], zlon[64];
+	struct timespec start;
+	struct sim_vessel *sp;
+
+	opterr = 0;
+	nvessels = 50000;
+	nsecs = 300;
+	interval = 10;
+	nzones = 20;
+	verbose = 0;
+	while ((i = getopt(argc, argv, "n:s:i:z:v")) != EOF) {
+		switch (i) {
+		case 'n':
+			if ((nvessels = atoi(optarg)) < 2)
+				usage();
+			break;
+
+		case 's':
+			if ((nsecs = atoi(optarg)) < 1)
+				usage();
+			break;
+
+		case 'i':
+			if ((interval = atoi(optarg)) < 1)
+				usage();
+			break;
+
+		case 'z':
+			if ((nzones = atoi(optarg)) < 1 || nzones > 64)
+				usage();
+			break;
+
+		case 'v':
+			verbose = 1;
+			break;
+
+		default:
+			usage();
+			break;
+		}
+	}
+	if ((fleet = malloc(nvessels * sizeof(*fleet))) == NULL) {
+		perror("cpa_bench: malloc");
+		exit(1);
+	}
+	/*
+	 * Busy areas are scattered across northern European waters, and
+	 * the vessels are bunched up around them. About a third are at
+	 * anchor or alongside. Most of the rest follow the traffic lanes
+	 * through each area, one way or the other, and a few wander.
+	 */
+	srand48(1);
+	for (i = 0; i < nzones; i++) {
+		zlat[i] = 48.0 + drand48() * 12.0;
+		zlon[i] = -8.0 + drand48() * 20.0;
+		zcog[i] = (int )(drand48() * 1800);
+	}
+	for (i = 0, sp = fleet; i < nvessels; i++, sp++) {
+		zone = i % nzones;
+		r = fabs(drand48() + drand48() + drand48() - 1.5) * 3.0;
+		a = drand48() * 2.0 * M_PI;
+		sp->mmsi = 200000000 + i;
+		sp->lat = zlat[zone] + r * cos(a);
+		sp->lon = zlon[zone] + r * sin(a) / cos(zlat[zone] * M_PI / 180.0);
+		sp->sog = drand48() < 0.33 ? 0 : 50 + (int )(drand48() * 200);
+		if ((d = drand48()) < 0.4)
+			sp->cog = zcog[zone] + (int )(drand48() * 200) - 100;
+		else if (d < 0.8)
+			sp->cog = zcog[zone] + 1800 + (int )(drand48() * 200) - 100;
+		else
+			sp->cog = (int )(drand48() * 3600);
+		sp->cog = (sp->cog + 3600) % 3600;
+	}
+	ais_cpa_init(&cpa, AIS_CPA_LIMIT, AIS_TCPA_LIMIT, AIS_CPA_RANGE, NULL, NULL);
+	printf("%d vessels in %d areas, reporting every %d secs, for %d secs...\n",
+				nvessels, nzones, interval, nsecs);
+	total = worst = 0.0;
+	for (t = 0; t < nsecs; t++) {
+		clock_gettime(CLOCK_MONOTONIC, &start);
+		for (i = t % interval, sp = &fleet[i]; i < nvessels; i += interval, sp += interval) {
+			d = sp->sog / 10.0 * interval / 3600.0;
+			sp->lat += d * cos(sp->cog * M_PI / 1800.0) / 60.0;
+			sp->lon += d * sin(sp->cog * M_PI / 1800.0) / (60.0 * cos(sp->lat * M_PI / 180.0));
+			ais_cpa_update(&cpa, sp->mmsi, t, (int )(sp->lat * 600000.0),
+							(int )(sp->lon * 600000.0), sp->sog, sp->cog);
+		}
+		if (t % 60 == 59)
+			ais_cpa_expire(&cpa, t);
+		secs = elapsed(&start);
+		total += secs;
+		if (secs > worst)
+			worst = secs;
+		if (verbose)
+			printf("%4d: %.3f ms, %d alerts\n", t, secs * 1000.0, cpa.nalerts);
+	}
+	printf("%lu updates, %.1f pairs/update, %.0f updates/sec.\n", cpa.nupdates,
+				cpa.nupdates > 0 ? (double )cpa.npairs / cpa.nupdates : 0.0,
+				total > 0.0 ? cpa.nupdates / total : 0.0);
+	printf("Per second of traffic: %.3f ms average, %.3f ms worst.\n",
+				total * 1000.0 / nsecs, worst * 1000.0);
+	printf("Alerts: %lu raised, %lu cleared, %d active, %lu lost.\n",
+				cpa.nraised, cpa.ncleared, cpa.nalerts, cpa.nlost);
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	ais_cpa_flush(&cpa);
+	printf("Flushed %d vessels in %.3f ms.\n", nvessels, elapsed(&start) * 1000.0);
+	free(fleet);
+	exit(0);
+}
+
+/*
+ * Seconds since the given time.
+ */
+double
+elapsed(struct timespec *tsp)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return((now.tv_sec - tsp->tv_sec) + (now.tv_nsec - tsp->tv_nsec) / 1000000000.0);
+}
+
+/*
+ *
+ */
+void
+usage()
+{
+	fprintf(stderr, "Usage: cpa_bench [-n <vessels>] [-s <secs>] [-i <interval>] [-z <areas>] [-v]\n");
+	exit(2);
+}
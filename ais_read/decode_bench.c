@@ -0,0 +1,279 @@
+/*
+ * Benchmark the payload decoder. Every message in a data file (raw
+ * NMEA or an ais_read log) is parsed once and its binary payload kept.
+ * Then the lot is decoded a number of times, once with the bit reader
+ * on its own and once with the fixed-offset position report decoder in
+ * front of it, and the records from each are checked against the other.
+ */
+#include <stdio.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "ais.h"
+
+#define MAXLINELEN			512
+
+struct payload {
+	int				chan;
+	int				len;
+	int				nbits;
+	int				hot;
+	unsigned char	*data;
+};
+
+char			input[MAXLINELEN+2];
+char			sentence[MAXLINELEN+8];
+struct payload	*payloads;
+int				npayloads;
+int				maxpayloads;
+unsigned char	*databuf;
+int				datalen;
+int				maxdata;
+
+void	save_message(void *, struct ais_msg *, struct ais_record *);
+double	run(int, int, int (*)(struct ais_msg *, struct ais_record *));
+int		nullfn(struct ais_msg *, struct ais_record *);
+int		check(void);
+double	elapsed(struct timespec *);
+void	usage();
+
+/*
+ *
+ */
+int
+main(int argc, char *argv[])
+{
+	int i, npasses, nhot;
+	double base, generic, fast, hbase, hgeneric, hfast;
+	FILE *fp;
+	struct nmea_parser parser;
+
+	opterr = 0;
+	npasses = 20;
+	while ((i = getopt(argc, argv, "r:")) != EOF) {
+		switch (i) {
+		case 'r':
+			if ((npasses = atoi(optarg)) < 1)
+				usage();
+			break;
+
+		default:
+			usage();
+			break;
+		}
+	}
+	if (optind != argc - 1)
+		usage();
+	if ((fp = fopen(argv[optind], "r")) == NULL) {
+		perror(argv[optind]);
+		exit(1);
+	}
+	nmea_init(&parser, NULL, save_message, NULL);
+	while (fgets(input, MAXLINELEN, fp) != NULL) {
+		if (nmea_logline(input, sentence, sizeof(sentence)) >= 0)
+			nmea_sentence(&parser, sentence);
+		else
+			nmea_feed(&parser, input, strlen(input));
+	}
+	nmea_flush(&parser);
+	fclose(fp);
+	if (npayloads == 0) {
+		fprintf(stderr, "?Error - no messages in %s.\n", argv[optind]);
+		exit(1);
+	}
+	/*
+	 * The buffer has finished moving about, so turn the offsets into
+	 * pointers.
+	 */
+	for (i = nhot = 0; i < npayloads; i++) {
+		payloads[i].data = databuf + (long )payloads[i].data;
+		switch (payloads[i].data[0] >> 2) {
+		case MSG_POSREP_A:
+		case MSG_POSREP_A_ASSIGNED:
+		case MSG_POSREP_A_RESPONSE:
+		case MSG_POSREP_B_CS:
+			payloads[i].hot = 1;
+			nhot++;
+			break;
+		}
+	}
+	printf("%d messages, %d (%.1f%%) position reports, %d passes...\n",
+				npayloads, nhot, nhot * 100.0 / npayloads, npasses);
+	if (check() != 0)
+		exit(1);
+	/*
+	 * Copying each payload into place costs the same either way, so
+	 * time that on its own and take it off.
+	 */
+	base = run(npasses, 0, nullfn);
+	generic = run(npasses, 0, ais_decode_generic) - base;
+	fast = run(npasses, 0, ais_decode) - base;
+	printf("All messages:     bit reader %.1f ns, fixed-offset %.1f ns",
+				generic * 1e9 / npayloads / npasses,
+				fast * 1e9 / npayloads / npasses);
+	if (fast > 0.0)
+		printf(" (%.2fx)", generic / fast);
+	putchar('\n');
+	if (nhot > 0) {
+		hbase = run(npasses, 1, nullfn);
+		hgeneric = run(npasses, 1, ais_decode_generic) - hbase;
+		hfast = run(npasses, 1, ais_decode) - hbase;
+		printf("Position reports: bit reader %.1f ns, fixed-offset %.1f ns",
+					hgeneric * 1e9 / nhot / npasses,
+					hfast * 1e9 / nhot / npasses);
+		if (hfast > 0.0)
+			printf(" (%.2fx)", hgeneric / hfast);
+		putchar('\n');
+	}
+	free(payloads);
+	free(databuf);
+	exit(0);
+}
+
+/*
+ * Keep a copy of the binary payload of each message as it's decoded.
+ */
+void
+save_message(void *arg, struct ais_msg *ap, struct ais_record *rp)
+{
+	int n;
+	struct payload *pp;
+
+	if (npayloads == maxpayloads) {
+		n = maxpayloads == 0 ? 65536 : maxpayloads * 2;
+		if ((pp = realloc(payloads, n * sizeof(*pp))) == NULL) {
+			perror("decode_bench: realloc");
+			exit(1);
+		}
+		payloads = pp;
+		maxpayloads = n;
+	}
+	while (datalen + ap->msg_len > maxdata) {
+		n = maxdata == 0 ? 1024 * 1024 : maxdata * 2;
+		if ((databuf = realloc(databuf, n)) == NULL) {
+			perror("decode_bench: realloc");
+			exit(1);
+		}
+		maxdata = n;
+	}
+	pp = &payloads[npayloads++];
+	pp->chan = ap->chan;
+	pp->len = ap->msg_len;
+	pp->nbits = ap->nbits;
+	pp->hot = 0;
+	pp->data = (unsigned char *)(long )datalen;
+	memcpy(databuf + datalen, ap->message, ap->msg_len);
+	datalen += ap->msg_len;
+}
+
+/*
+ * Put a saved payload into a message, ready for decoding.
+ */
+static void
+load(struct ais_msg *ap, struct payload *pp)
+{
+	ap->chan = pp->chan;
+	ap->msg_len = pp->len;
+	ap->nbits = pp->nbits;
+	memcpy(ap->message, pp->data, pp->len);
+	ap->msg_offset = ap->bit_count = ap->bit_error = 0;
+	ap->bit_reg = 0;
+}
+
+/*
+ * Decode every payload with both decoders, and make sure they agree.
+ * The records are cleared first so that any field left alone by one
+ * and not the other shows up.
+ */
+int
+check()
+{
+	int i, nbad, r1, r2;
+	struct ais_msg msg;
+	struct ais_record rec1, rec2;
+
+	for (i = nbad = 0; i < npayloads; i++) {
+		memset(&rec1, 0, sizeof(rec1));
+		memset(&rec2, 0, sizeof(rec2));
+		load(&msg, &payloads[i]);
+		r1 = ais_decode_generic(&msg, &rec1);
+		load(&msg, &payloads[i]);
+		r2 = ais_decode(&msg, &rec2);
+		if (r1 != r2 || memcmp(&rec1, &rec2, sizeof(rec1)) != 0) {
+			if (nbad++ < 10)
+				fprintf(stderr, "?Error - message %d (type %d, MMSI %09u) decodes differently.\n",
+							i, rec1.type, rec1.mmsi);
+		}
+	}
+	if (nbad > 0)
+		fprintf(stderr, "?Error - %d mismatches.\n", nbad);
+	return(nbad);
+}
+
+/*
+ * Time a number of passes over every payload (or just the position
+ * reports) with the given decoder.
+ */
+double
+run(int npasses, int hot, int (*decode)(struct ais_msg *, struct ais_record *))
+{
+	int i;
+	unsigned long sum;
+	struct ais_msg msg;
+	struct ais_record rec;
+	struct payload *pp;
+	struct timespec start;
+
+	sum = 0;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	while (npasses-- > 0) {
+		for (i = 0, pp = payloads; i < npayloads; i++, pp++) {
+			if (hot && !pp->hot)
+				continue;
+			load(&msg, pp);
+			if (decode(&msg, &rec) == 0)
+				sum += rec.mmsi + rec.lat + rec.lon;
+		}
+	}
+	/*
+	 * Use the results, so none of the work can be thrown away.
+	 */
+	if (sum == 1)
+		putchar('\n');
+	return(elapsed(&start));
+}
+
+/*
+ * No decoding at all, for the baseline.
+ */
+int
+nullfn(struct ais_msg *ap, struct ais_record *rp)
+{
+	rp->mmsi = ap->message[1];
+	rp->lat = rp->lon = 0;
+	return(0);
+}
+
+/*
+ * Seconds since the given time.
+ */
+double
+elapsed(struct timespec *tsp)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return((now.tv_sec - tsp->tv_sec) + (now.tv_nsec - tsp->tv_nsec) / 1000000000.0);
+}
+
+/*
+ *
+ */
+void
+usage()
+{
+	fprintf(stderr, "Usage: decode_bench [-r <passes>] <datafile>\n");
+	exit(2);
+}
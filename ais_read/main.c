@@ -50,8 +50,25 @@
 #include <netdb.h>
 #include <sys/select.h>
 #include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <math.h>
+#include <sys/ioctl.h>
+#ifdef __linux__
+#include <linux/serial.h>
+#endif
+
+#include "ais.h"
+#include "ais_ring.h"
+#include "ais_resolve.h"
+#include "ais_pool.h"
+#include "ais_simplify.h"
+#include "ais_cpa.h"
+#include "ais_stats.h"
+#include "ais_seq.h"
 
 #define BUFFER_SIZE		512
+#define SEQ_REPORT		600
 
 struct baud_rate {
 	speed_t		sval;
@@ -71,17 +88,98 @@ struct baud_rate {
 
 int		serfd;
 int		ufd;
-int		rdoffset;
-char	rdbuffer[BUFFER_SIZE + 2];
+int		pending_fd;
+int		pending_idx;
+int		uplink_failed;
+struct ais_resolver		resolver;
+struct ais_resolve		uplink_res;
+struct sockaddr_storage	uplink_addrs[AIS_RESOLVE_MAXADDR];
+socklen_t				uplink_addrlens[AIS_RESOLVE_MAXADDR];
+int						uplink_naddrs;
+struct sockaddr_storage	uplink_addr;
+socklen_t				uplink_addrlen;
 char	*datadir;
+struct nmea_parser	parser;
+struct ais_ring		*ring;
+int					decode;
+
+/*
+ * Replay state. A speed of zero means "as fast as possible".
+ */
+double			replay_speed;
+double			replay_logtime;
+int				replay_last;
+struct timespec	replay_start;
+unsigned long	nlines;
+
+/*
+ * Uplink simplification. Each sentence is held back until we know
+ * whether it's worth sending.
+ */
+int				simplifying;
+int				data_time;
+int				last_expire;
+struct ais_simplify	simp;
+char			held[NMEA_MAXLINE + 2];
+int				held_len;
+
+/*
+ * Collision-risk alerts.
+ */
+int				cpa_on;
+int				cpa_expired;
+struct ais_cpa	cpa;
+
+/*
+ * Receiver statistics. A SIGUSR1 prints the current window.
+ */
+char			*statsdir;
+struct ais_stats	stats;
+volatile sig_atomic_t	stats_query;
+
+/*
+ * TAG block framing on the uplink, and accounting for any tagged
+ * sentences coming in.
+ */
+char			*tag_name;
+unsigned long	tag_seq;
+struct ais_seqtab	seqtab;
+
+/*
+ * Low-latency ingest. Each sentence is stamped (in microseconds) when
+ * its first byte was read, and the histogram counts how long it then
+ * takes to get it up the uplink, in powers of two.
+ */
+int				low_latency;
+long long		held_rt;
+long long		held_mono;
+unsigned long	latency_hist[32];
 
 void	process();
 void	serial_open(char *, speed_t);
 void	serial_read();
-void	ais_data(char *, int);
-void	tcp_open(char *, int);
+void	replay(int, char *[]);
+void	replay_file(char *);
+void	replay_wait(int);
+void	ais_data(void *, char *, int);
+void	ais_message(void *, struct ais_msg *, struct ais_record *);
+void	cpa_alert(void *, int, struct ais_cpa_alert *);
+void	stats_check(long);
+void	stats_signal(int);
+void	ring_open(char *);
+void	uplink_open(char *, int, int);
+int		uplink_fdset(fd_set *, fd_set *, int);
+void	uplink_events(fd_set *, fd_set *);
+void	uplink_poll(int);
+void	uplink_resolved();
+void	uplink_try(int);
+void	uplink_check();
+void	uplink_hold(char *, int);
+void	uplink_release();
+void	uplink_send(char *, int, long long, long long);
+void	stamp_now();
+void	latency_print();
 void	tcp_write(char *, int);
-void	make_path(char *);
 void	usage();
 
 /*
@@ -90,8 +188,9 @@ void	usage();
 int
 main(int argc, char *argv[])
 {
-	int i, speed, port;
-	char *device, *host;
+	int i, n, speed, port, replaying, interval;
+	char *device, *host, *shmname;
+	double tolerance, cpa_miles, tcpa_mins, cpa_range, rx_lat, rx_lon;
 
 	opterr = 0;
 	speed = B9600;
@@ -99,8 +198,25 @@ main(int argc, char *argv[])
 	device = "/dev/ttyS0";
 	host = "data.aishub.net";
 	datadir = NULL;
-	while ((i = getopt(argc, argv, "l:s:h:p:d:")) != EOF) {
+	replaying = decode = 0;
+	replay_speed = 1.0;
+	shmname = NULL;
+	interval = AIS_RESOLVE_INTERVAL;
+	tolerance = 0.0;
+	statsdir = NULL;
+	rx_lat = rx_lon = 1000.0;
+	while ((i = getopt(argc, argv, "l:s:h:p:d:r:m:Di:T:A:S:P:t:L")) != EOF) {
 		switch (i) {
+		case 'L':
+			low_latency = 1;
+			break;
+
+		case 't':
+			if (strlen(optarg) >= NMEA_TAG_SRCLEN || strpbrk(optarg, ",*\\!") != NULL)
+				usage();
+			tag_name = optarg;
+			break;
+
 		case 'l':
 			device = optarg;
 			break;
@@ -130,14 +246,102 @@ main(int argc, char *argv[])
 			datadir = optarg;
 			break;
 
+		case 'r':
+			if ((replay_speed = atof(optarg)) < 0.0)
+				usage();
+			replaying = 1;
+			break;
+
+		case 'm':
+			shmname = optarg;
+			break;
+
+		case 'D':
+			decode = 1;
+			break;
+
+		case 'i':
+			interval = atoi(optarg);
+			break;
+
+		case 'T':
+			if ((tolerance = atof(optarg)) <= 0.0)
+				usage();
+			simplifying = 1;
+			break;
+
+		case 'A':
+			/*
+			 * The search range is worked out from the limits,
+			 * unless it's given as well.
+			 */
+			cpa_range = 0.0;
+			if ((n = sscanf(optarg, "%lf,%lf,%lf", &cpa_miles, &tcpa_mins, &cpa_range)) < 2 ||
+						cpa_miles <= 0.0 || tcpa_mins <= 0.0 ||
+						(n == 3 && cpa_range <= cpa_miles))
+				usage();
+			cpa_on = 1;
+			break;
+
+		case 'S':
+			statsdir = optarg;
+			break;
+
+		case 'P':
+			if (sscanf(optarg, "%lf,%lf", &rx_lat, &rx_lon) != 2 ||
+						fabs(rx_lat) > 90.0 || fabs(rx_lon) > 180.0)
+				usage();
+			break;
+
 		default:
 			usage();
 			break;
 		}
 	}
-	serial_open(device, speed);
-	tcp_open(host, port);
-	process();
+	if (replaying && optind >= argc)
+		usage();
+	if (decode && shmname == NULL)
+		usage();
+	ring = NULL;
+	if (shmname != NULL)
+		ring_open(shmname);
+	if (simplifying)
+		ais_simp_init(&simp, AIS_SIMP_DR, tolerance, AIS_SIMP_MAXGAP, NULL, NULL);
+	if (cpa_on)
+		ais_cpa_init(&cpa, cpa_miles * 1852.0, tcpa_mins * 60.0, cpa_range > 0.0 ?
+						cpa_range * 1852.0 : ais_cpa_range(cpa_miles * 1852.0, tcpa_mins * 60.0),
+						cpa_alert, NULL);
+	if (statsdir != NULL) {
+		ais_stats_init(&stats, "local", time(NULL));
+		if (rx_lat <= 90.0)
+			ais_stats_position(&stats, rx_lat * 600000.0, rx_lon * 600000.0);
+		signal(SIGUSR1, stats_signal);
+	}
+	nmea_init(&parser, ais_data, (decode || simplifying || cpa_on || statsdir != NULL) ?
+											ais_message : NULL, NULL);
+	/*
+	 * A host of "-" means no uplink at all, which is mostly
+	 * useful for benchmarking a replay.
+	 */
+	ufd = pending_fd = -1;
+	if (strcmp(host, "-") != 0)
+		uplink_open(host, port, interval);
+	if (replaying) {
+		/*
+		 * No point replaying into thin air, so wait for the
+		 * uplink to come up first.
+		 */
+		while (strcmp(host, "-") != 0 && ufd < 0) {
+			if (uplink_failed)
+				exit(2);
+			uplink_poll(1000);
+		}
+		replay(argc - optind, argv + optind);
+	}
+	else {
+		serial_open(device, speed);
+		process();
+	}
 	exit(0);
 }
 
@@ -147,25 +351,38 @@ main(int argc, char *argv[])
 void
 process()
 {
-	int n, running = 1;
+	int n, maxfd, running = 1;
+	time_t now, last_report;
 	struct timeval tval;
-	fd_set rdfds;
+	fd_set rdfds, wrfds;
 
 	printf("Processing...\n");
-	rdoffset = 0;
+	last_report = time(NULL);
 	while (running) {
 		FD_ZERO(&rdfds);
+		FD_ZERO(&wrfds);
 		FD_SET(serfd, &rdfds);
+		maxfd = uplink_fdset(&rdfds, &wrfds, serfd);
 		tval.tv_sec = 5;
 		tval.tv_usec = 0;
-		if ((n = select(serfd + 1, &rdfds, NULL, NULL, &tval)) < 0) {
+		if ((n = select(maxfd + 1, &rdfds, &wrfds, NULL, &tval)) < 0) {
+			if (errno == EINTR)
+				continue;
 			perror("ais_read (select)");
 			exit(1);
 		}
-		if (n == 0)
-			continue;
-		if (FD_ISSET(serfd, &rdfds))
+		uplink_events(&rdfds, &wrfds);
+		if (n > 0 && FD_ISSET(serfd, &rdfds))
 			serial_read();
+		now = time(NULL);
+		if (statsdir != NULL)
+			stats_check(now);
+		if (now - last_report >= SEQ_REPORT) {
+			ais_seq_print(&seqtab, stdout);
+			latency_print();
+			fflush(stdout);
+			last_report = now;
+		}
 	}
 }
 
@@ -192,11 +409,35 @@ serial_open(char *dev, speed_t speed)
 	term.c_cflag = CS8|CREAD|CLOCAL;
 	term.c_lflag = 0;
 	cfsetispeed(&term, speed);
+	if (low_latency) {
+		/*
+		 * Hand over every byte as soon as it arrives, rather
+		 * than whenever the driver gets round to it.
+		 */
+		term.c_cc[VMIN] = 1;
+		term.c_cc[VTIME] = 0;
+	}
 
 	if (tcsetattr(serfd, TCSANOW, &term) < 0) {
 		perror("ais_read (tcsetattr)");
 		exit(1);
 	}
+#if defined(TIOCSSERIAL) && defined(ASYNC_LOW_LATENCY)
+	if (low_latency) {
+		struct serial_struct ss;
+
+		/*
+		 * Not every UART driver has this, and that's fine.
+		 */
+		if (ioctl(serfd, TIOCGSERIAL, &ss) < 0) {
+			printf("No low-latency setting for [%s].\n", dev);
+			return;
+		}
+		ss.flags |= ASYNC_LOW_LATENCY;
+		if (ioctl(serfd, TIOCSSERIAL, &ss) < 0)
+			perror("ais_read (TIOCSSERIAL)");
+	}
+#endif
 }
 
 /*
@@ -206,7 +447,8 @@ void
 serial_read()
 {
 	int nbytes;
-	char *cp;
+	unsigned long nbad;
+	char rdbuffer[BUFFER_SIZE];
 
 	/*
 	 * Set an alarm here, because sometimes the device goes off
@@ -215,71 +457,199 @@ serial_read()
 	 * want to fail too often or Docker will get annoyed.
 	 */
 	alarm(60*60);
-	if ((nbytes = read(serfd, rdbuffer + rdoffset, BUFFER_SIZE - rdoffset)) < 0) {
+	if ((nbytes = read(serfd, rdbuffer, BUFFER_SIZE)) < 0) {
 		perror("ais_read (process read)");
 		exit(1);
 	}
 	alarm(0);
-	rdoffset += nbytes;
-	rdbuffer[rdoffset] = '\0';
-	if ((cp = strrchr(rdbuffer, '\n')) == NULL || (nbytes = cp - rdbuffer + 1) < 5)
+	stamp_now();
+	nbad = parser.nbadcsum;
+	data_time = parser.feed_rt / 1000000;
+	nmea_feed(&parser, rdbuffer, nbytes);
+	uplink_release();
+	if (parser.nbadcsum != nbad)
+		fprintf(stderr, "?Error - invalid checksum in serial data.\n");
+}
+
+/*
+ * Replay a set of archived log files instead of reading the serial
+ * port. The data goes through the same framing, validation, logging
+ * and uplink as live data, paced by the timestamp on each line.
+ */
+void
+replay(int nfiles, char *files[])
+{
+	int i;
+	double secs;
+	struct timespec now;
+
+	printf("Replaying %d file(s) at ", nfiles);
+	if (replay_speed > 0.0)
+		printf("%gx speed...\n", replay_speed);
+	else
+		printf("full speed...\n");
+	replay_last = -1;
+	replay_logtime = 0.0;
+	clock_gettime(CLOCK_MONOTONIC, &replay_start);
+	for (i = 0; i < nfiles; i++)
+		replay_file(files[i]);
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	secs = (now.tv_sec - replay_start.tv_sec) +
+				(now.tv_nsec - replay_start.tv_nsec) / 1000000000.0;
+	printf("Replayed %lu lines (%lu bad) in %.3f secs", nlines,
+				nlines - parser.nsentences, secs);
+	if (secs > 0.0)
+		printf(" - %.0f lines/sec", nlines / secs);
+	printf(".\n");
+	if (simplifying)
+		printf("Sent %lu of %lu positions to the uplink.\n",
+					simp.npoints_out, simp.npoints_in);
+	if (statsdir != NULL)
+		ais_stats_print(&stats, stdout);
+	ais_seq_print(&seqtab, stdout);
+	latency_print();
+}
+
+/*
+ * Stamp whatever we're about to feed the parser with the time now.
+ */
+void
+stamp_now()
+{
+	struct timespec rt, mono;
+
+	clock_gettime(CLOCK_REALTIME, &rt);
+	clock_gettime(CLOCK_MONOTONIC, &mono);
+	nmea_stamp(&parser, rt.tv_sec * 1000000LL + rt.tv_nsec / 1000,
+						mono.tv_sec * 1000000LL + mono.tv_nsec / 1000);
+}
+
+/*
+ * Print the wire-to-uplink latency histogram, if there's anything in
+ * it.
+ */
+void
+latency_print()
+{
+	int i;
+	char *sep;
+
+	for (i = 0; i < 32 && latency_hist[i] == 0; i++)
+		;
+	if (i == 32)
 		return;
-	*cp = '\0';
-	if (strncmp(rdbuffer, "!AIV", 4) == 0)
-		ais_data(rdbuffer, nbytes);
-	rdoffset -= nbytes;
-	if (rdoffset > 0)
-		memmove(rdbuffer, &rdbuffer[nbytes], rdoffset);
+	printf("Latency (usecs):");
+	for (i = 0, sep = " "; i < 32; i++) {
+		if (latency_hist[i] == 0)
+			continue;
+		printf("%s<%lu:%lu", sep, 1UL << i, latency_hist[i]);
+		sep = ", ";
+	}
+	putchar('\n');
 }
 
 /*
- * Deal with a line of AIS data.
+ * Replay a single log file, pushing each line back through the
+ * framer just as if it had been read from the serial port.
  */
 void
-ais_data(char *datap, int len)
+replay_file(char *fname)
 {
-	unsigned int oldch, my_csum, their_csum;
-	char *cp, *endcp;
-	static FILE *logfp = NULL;
-	static int last_hour = 0;
+	int logsecs, len;
+	char line[BUFFER_SIZE], sentence[BUFFER_SIZE + 8];
+	FILE *fp;
 
-	oldch = 0;
-	if ((endcp = strpbrk(datap, "\r\n")) != NULL) {
-		oldch = *endcp;
-		*endcp = '\0';
+	printf("Replay [%s]...\n", fname);
+	if ((fp = fopen(fname, "r")) == NULL) {
+		fprintf(stderr, "ais_read (replay_file): ");
+		perror(fname);
+		exit(1);
 	}
-	for (my_csum = 0, cp = datap + 1; *cp != '\0' && *cp != '*'; cp++)
-		my_csum ^= *cp;
-	if (*cp != '*') {
-		fprintf(stderr, "?Error - missing checksum in serial data.\n%s\n", datap);
-		return;
+	while (fgets(line, sizeof(line), fp) != NULL) {
+		if ((++nlines % 1024) == 0) {
+			uplink_poll(0);
+			if (statsdir != NULL)
+				stats_check(time(NULL));
+		}
+		if ((logsecs = nmea_logline(line, sentence, sizeof(sentence) - 2)) < 0)
+			continue;
+		replay_wait(logsecs);
+		data_time = (int )replay_logtime;
+		stamp_now();
+		len = strlen(sentence);
+		sentence[len++] = '\r';
+		sentence[len++] = '\n';
+		nmea_feed(&parser, sentence, len);
+		uplink_release();
 	}
-	*cp = '\0';
-	their_csum = (int )strtol(cp + 1, NULL, 16);
-	if (my_csum != their_csum) {
-		fprintf(stderr, "?Error - invalid checksum in serial data.\n%s\n", datap);
-		return;
+	fclose(fp);
+}
+
+/*
+ * Wait until it's time to play a line logged at the given second of
+ * the day. The log only tells us the time of day, so a big step
+ * backwards is taken as midnight, and a small one (a clock change,
+ * or lines logged slightly out of order) as no time at all.
+ */
+void
+replay_wait(int logsecs)
+{
+	double delta, wait;
+	struct timespec now, ts;
+
+	if (replay_last < 0)
+		replay_last = logsecs;
+	if ((delta = logsecs - replay_last) < -43200.0)
+		delta += 86400.0;
+	if (delta > 0.0) {
+		replay_logtime += delta;
+		replay_last = logsecs;
 	}
+	if (replay_speed <= 0.0)
+		return;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	wait = replay_logtime / replay_speed - (now.tv_sec - replay_start.tv_sec) -
+				(now.tv_nsec - replay_start.tv_nsec) / 1000000000.0;
+	if (wait <= 0.0)
+		return;
+	ts.tv_sec = (time_t )wait;
+	ts.tv_nsec = (long )((wait - ts.tv_sec) * 1000000000.0);
+	while (nanosleep(&ts, &ts) < 0 && errno == EINTR)
+		;
+}
+
+/*
+ * Deal with a validated line of AIS data.
+ */
+void
+ais_data(void *arg, char *datap, int len)
+{
+	char *cp;
+	static FILE *logfp = NULL;
+	static int last_hour = 0;
+
+	if (parser.tag.flags != 0)
+		ais_seq_update(&seqtab, &parser.tag, parser.line_rt / 1000);
+
 	if (datadir != NULL) {
-		char *fpath;
+		char fpath[BUFFER_SIZE];
 		struct tm *tmp;
 		time_t now;
 
-		time(&now);
+		now = parser.line_rt / 1000000;
 		tmp = localtime(&now);
 		if (logfp == NULL || last_hour != tmp->tm_hour) {
 			if (logfp != NULL)
 				fclose(logfp);
-			if ((fpath = malloc(strlen(datadir) + 32)) == NULL) {
-				perror("malloc");
-				exit(1);
-			}
-			sprintf(fpath, "%s/%04d%02d%02d", datadir,
+			snprintf(fpath, sizeof(fpath), "%s/%04d%02d%02d", datadir,
 							tmp->tm_year + 1900,
 							tmp->tm_mon + 1,
 							tmp->tm_mday);
-			make_path(fpath);
-			sprintf(fpath, "%s/%04d%02d%02d/ais%02d.log", datadir,
+			if (ais_make_path(fpath) < 0) {
+				perror(fpath);
+				exit(1);
+			}
+			snprintf(fpath, sizeof(fpath), "%s/%04d%02d%02d/ais%02d.log", datadir,
 							tmp->tm_year + 1900,
 							tmp->tm_mon + 1,
 							tmp->tm_mday, tmp->tm_hour);
@@ -287,87 +657,385 @@ ais_data(char *datap, int len)
 				perror(fpath);
 				exit(1);
 			}
-			free(fpath);
 			last_hour = tmp->tm_hour;
 		}
-		fprintf(logfp, "%02d:%02d:%02d:%s\n", tmp->tm_hour, tmp->tm_min,
-							tmp->tm_sec, datap + 1);
+		/*
+		 * The log has never held the leading '!' or the checksum.
+		 */
+		cp = strchr(datap, '*');
+		fprintf(logfp, "%02d:%02d:%02d", tmp->tm_hour, tmp->tm_min, tmp->tm_sec);
+		if (low_latency)
+			fprintf(logfp, ".%06d", (int )(parser.line_rt % 1000000));
+		fprintf(logfp, ":%.*s\n", (int )(cp - datap - 1), datap + 1);
 		fflush(logfp);
 	}
-	*cp = '*';
-	if (endcp != NULL)
-		*endcp = oldch;
-	tcp_write(datap, len);
+	if (ring != NULL)
+		ais_ring_put(ring, AIS_RING_SENTENCE, datap, len, parser.line_rt);
+	if (statsdir != NULL)
+		ais_stats_sentence(&stats);
+	if (simplifying)
+		uplink_hold(datap, len);
+	else
+		uplink_send(datap, len, parser.line_rt, parser.line_mono);
 }
 
 /*
- *
+ * Deal with a decoded AIS message. Publish it for any local consumers,
+ * check it for collision risk, and if we're simplifying the uplink,
+ * drop the sentence we're holding if it doesn't tell anyone anything
+ * new.
  */
 void
-tcp_open(char *host, int port)
+ais_message(void *arg, struct ais_msg *ap, struct ais_record *rp)
 {
-	struct sockaddr_in sin;
-	in_addr_t addr;
+	struct ais_spoint pt;
 
-	if ((addr = inet_addr(host)) == INADDR_NONE) {
-		struct hostent *hp;
-
-		if ((hp = gethostbyname(host)) == NULL) {
-			fprintf(stderr, "?Error - unresolved hostname: %s\n", host);
-			exit(2);
+	if (decode)
+		ais_ring_put(ring, AIS_RING_RECORD, rp, sizeof(*rp), parser.line_rt);
+	if (statsdir != NULL)
+		ais_stats_record(&stats, rp);
+	if (cpa_on && (rp->flags & (AIS_HAS_POSITION|AIS_HAS_MOTION)) == (AIS_HAS_POSITION|AIS_HAS_MOTION)) {
+		ais_cpa_update(&cpa, rp->mmsi, data_time, rp->lat, rp->lon, rp->sog, rp->cog);
+		if (data_time - cpa_expired >= 60) {
+			ais_cpa_expire(&cpa, data_time);
+			cpa_expired = data_time;
 		}
-		memcpy((char *)&addr, hp->h_addr, hp->h_length);
 	}
-	if ((ufd = socket(PF_INET, SOCK_STREAM, IPPROTO_TCP)) < 0) {
-		perror("ais_read (tcp_open)");
+	if (!simplifying || ap->nfrags != 1 || !ais_simp_wanted(rp->type) ||
+							!(rp->flags & AIS_HAS_POSITION))
+		return;
+	pt.time = data_time;
+	pt.lat = rp->lat;
+	pt.lon = rp->lon;
+	pt.sog = rp->sog;
+	pt.cog = rp->cog;
+	pt.heading = rp->heading;
+	pt.type = rp->type;
+	pt.nav_status = rp->nav_status;
+	if (ais_simp_add(&simp, rp->mmsi, &pt) == 0)
+		held_len = 0;
+	if (data_time - last_expire >= 60) {
+		ais_simp_expire(&simp, data_time);
+		last_expire = data_time;
+	}
+}
+
+/*
+ * Report a collision-risk alert being raised or cleared.
+ */
+void
+cpa_alert(void *arg, int state, struct ais_cpa_alert *alp)
+{
+	if (state == AIS_CPA_RAISE)
+		printf("CPA alert: %09u and %09u, %.2fnm in %.1f mins.\n", alp->mmsi1,
+					alp->mmsi2, alp->cpa / 1852.0, alp->tcpa / 60.0);
+	else
+		printf("CPA clear: %09u and %09u.\n", alp->mmsi1, alp->mmsi2);
+	fflush(stdout);
+}
+
+/*
+ * Deal with any statistics query, and if the window is over, append
+ * its summary to the day's stats file and start a new one.
+ */
+void
+stats_check(long now)
+{
+	char fpath[BUFFER_SIZE];
+	time_t when;
+	struct tm *tmp;
+	FILE *fp;
+
+	if (stats_query) {
+		stats_query = 0;
+		ais_stats_print(&stats, stdout);
+		fflush(stdout);
+	}
+	if (now < stats.window + AIS_STATS_WINDOW)
+		return;
+	when = stats.window;
+	tmp = localtime(&when);
+	snprintf(fpath, sizeof(fpath), "%s/%04d%02d%02d", statsdir,
+					tmp->tm_year + 1900, tmp->tm_mon + 1, tmp->tm_mday);
+	if (ais_make_path(fpath) < 0) {
+		perror(fpath);
 		exit(1);
 	}
-	memset(&sin, 0, sizeof(struct sockaddr_in));
-	sin.sin_family = AF_INET;
-	sin.sin_addr.s_addr = addr;
-	sin.sin_port = htons(port);
-	if (connect(ufd, (const struct sockaddr *)&sin, sizeof(struct sockaddr_in)) < 0) {
-		perror("ais_read (connect)");
+	strncat(fpath, "/stats.log", sizeof(fpath) - strlen(fpath) - 1);
+	if ((fp = fopen(fpath, "a")) == NULL) {
+		perror(fpath);
 		exit(1);
 	}
+	ais_stats_print(&stats, fp);
+	fclose(fp);
+	ais_stats_reset(&stats, now);
 }
 
 /*
- *
+ * SIGUSR1 asks for the statistics so far.
  */
 void
-tcp_write(char *bufp, int nbytes)
+stats_signal(int sig)
 {
-	if (write(ufd, bufp, nbytes) != nbytes) {
-		perror("ais_read (tcp_write)");
+	stats_query = 1;
+}
+
+/*
+ * Hold on to a sentence for the uplink until it has been decoded,
+ * sending whatever was held before.
+ */
+void
+uplink_hold(char *datap, int len)
+{
+	uplink_release();
+	memcpy(held, datap, len);
+	held_len = len;
+	held_rt = parser.line_rt;
+	held_mono = parser.line_mono;
+}
+
+/*
+ * Send the held sentence, if it's still wanted.
+ */
+void
+uplink_release()
+{
+	if (held_len > 0)
+		uplink_send(held, held_len, held_rt, held_mono);
+	held_len = 0;
+}
+
+/*
+ * Send a sentence up the uplink, framed with a TAG block if we've been
+ * asked to. The TAG time is when the sentence arrived, and how long it
+ * took from there to here goes in the histogram.
+ */
+void
+uplink_send(char *datap, int len, long long rt, long long mono)
+{
+	int i, n;
+	long long usecs;
+	char outbuf[NMEA_TAG_MAXLEN + NMEA_MAXLINE + 2];
+	struct timespec now;
+
+	/*
+	 * Nothing is sent without an uplink, so don't use up a sequence
+	 * number, or the far end will count it as lost.
+	 */
+	if (ufd < 0)
+		return;
+	n = 0;
+	if (tag_name != NULL) {
+		if ((n = nmea_tag_build(outbuf, NMEA_TAG_MAXLEN, tag_name,
+										tag_seq + 1, rt / 1000)) < 0)
+			n = 0;
+		else
+			tag_seq++;
+	}
+	memcpy(outbuf + n, datap, len);
+	len += n;
+	outbuf[len++] = '\r';
+	outbuf[len++] = '\n';
+	tcp_write(outbuf, len);
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	usecs = now.tv_sec * 1000000LL + now.tv_nsec / 1000 - mono;
+	for (i = 0; i < 31 && (1LL << i) <= usecs; i++)
+		;
+	latency_hist[i]++;
+}
+
+/*
+ * Create the shared-memory ring for local consumers.
+ */
+void
+ring_open(char *name)
+{
+	printf("Opening shared memory ring [%s]...\n", name);
+	if ((ring = ais_ring_create(name, AIS_RING_NSLOTS)) == NULL) {
+		fprintf(stderr, "ais_read (ring_open): ");
+		perror(name);
 		exit(1);
 	}
 }
 
 /*
- *
+ * Start looking up the uplink. Nothing waits for DNS, or for the TCP
+ * connection - it all happens in the background, and until the uplink
+ * is up, data is just logged. The name is looked up again every so
+ * often, and if the address changes a new connection is made and
+ * swapped in.
  */
 void
-make_path(char *path)
+uplink_open(char *host, int port, int interval)
 {
-	char *cp;
-	struct stat stbuf;
+	if (ais_resolver_init(&resolver, interval) < 0) {
+		perror("ais_read (resolver)");
+		exit(1);
+	}
+	ais_resolver_add(&resolver, &uplink_res, host, port, SOCK_STREAM,
+						AIS_RESOLVE_REPEAT, NULL);
+}
 
-	printf("Make directory [%s] if it doesn't exist...\n", path);
-	if (stat(path, &stbuf) >= 0) {
-		if ((stbuf.st_mode & S_IFMT) != S_IFDIR) {
-			fprintf(stderr, "?Error - path '%s' is not a directory.\n", path);
-			exit(1);
-		}
+/*
+ * Add the uplink file descriptors to a select set.
+ */
+int
+uplink_fdset(fd_set *rdfds, fd_set *wrfds, int maxfd)
+{
+	int fd;
+
+	if (uplink_res.host == NULL)
+		return(maxfd);
+	ais_resolver_tick(&resolver, time(NULL));
+	fd = ais_resolver_fd(&resolver);
+	FD_SET(fd, rdfds);
+	if (fd > maxfd)
+		maxfd = fd;
+	if (pending_fd >= 0) {
+		FD_SET(pending_fd, wrfds);
+		if (pending_fd > maxfd)
+			maxfd = pending_fd;
+	}
+	return(maxfd);
+}
+
+/*
+ * Deal with anything select() had to say about the uplink.
+ */
+void
+uplink_events(fd_set *rdfds, fd_set *wrfds)
+{
+	if (uplink_res.host == NULL)
 		return;
+	if (FD_ISSET(ais_resolver_fd(&resolver), rdfds))
+		uplink_resolved();
+	if (pending_fd >= 0 && FD_ISSET(pending_fd, wrfds))
+		uplink_check();
+}
+
+/*
+ * Check on the uplink, waiting for up to the given time.
+ */
+void
+uplink_poll(int msecs)
+{
+	int maxfd;
+	struct timeval tval;
+	fd_set rdfds, wrfds;
+
+	if (uplink_res.host == NULL)
+		return;
+	FD_ZERO(&rdfds);
+	FD_ZERO(&wrfds);
+	maxfd = uplink_fdset(&rdfds, &wrfds, -1);
+	tval.tv_sec = msecs / 1000;
+	tval.tv_usec = (msecs % 1000) * 1000;
+	if (select(maxfd + 1, &rdfds, &wrfds, NULL, &tval) > 0)
+		uplink_events(&rdfds, &wrfds);
+}
+
+/*
+ * The uplink name has been (re-)resolved. If we're connected to one of
+ * the addresses, carry on. Otherwise start connecting to the new one.
+ */
+void
+uplink_resolved()
+{
+	int i;
+	struct ais_resolve *rp;
+
+	while ((rp = ais_resolver_next(&resolver)) != NULL) {
+		if (rp->status != 0) {
+			fprintf(stderr, "?Error - unresolved hostname: %s (%s)\n",
+							rp->host, gai_strerror(rp->status));
+			uplink_failed = 1;
+			continue;
+		}
+		if (ufd >= 0 && ais_resolve_has(rp, (struct sockaddr *)&uplink_addr, uplink_addrlen))
+			continue;
+		if (pending_fd >= 0) {
+			close(pending_fd);
+			pending_fd = -1;
+		}
+		/*
+		 * Keep our own copy of the addresses, as we may be working
+		 * through them for a while.
+		 */
+		for (i = 0; i < rp->naddrs; i++) {
+			memcpy(&uplink_addrs[i], &rp->addrs[i], rp->addrlens[i]);
+			uplink_addrlens[i] = rp->addrlens[i];
+		}
+		uplink_naddrs = rp->naddrs;
+		uplink_try(0);
 	}
-	if ((cp = strrchr(path, '/')) != NULL) {
-		*cp = '\0';
-		make_path(path);
-		*cp = '/';
+}
+
+/*
+ * Start a non-blocking connection to the next uplink address.
+ */
+void
+uplink_try(int idx)
+{
+	int fd;
+
+	for (; idx < uplink_naddrs; idx++) {
+		if ((fd = socket(uplink_addrs[idx].ss_family, SOCK_STREAM, IPPROTO_TCP)) < 0)
+			continue;
+		fcntl(fd, F_SETFL, O_NONBLOCK);
+		if (connect(fd, (struct sockaddr *)&uplink_addrs[idx], uplink_addrlens[idx]) == 0 ||
+																errno == EINPROGRESS) {
+			pending_fd = fd;
+			pending_idx = idx;
+			return;
+		}
+		close(fd);
 	}
-	if (mkdir(path, 0755) < 0) {
-		perror(path);
+	fprintf(stderr, "?Error - can't connect to uplink %s.\n", uplink_res.host);
+	uplink_failed = 1;
+}
+
+/*
+ * A pending connection has finished, one way or the other. If it
+ * worked, swap it in for the old one.
+ */
+void
+uplink_check()
+{
+	int err, oldfd;
+	socklen_t len;
+	char abuf[64];
+
+	len = sizeof(err);
+	if (getsockopt(pending_fd, SOL_SOCKET, SO_ERROR, &err, &len) < 0 || err != 0) {
+		close(pending_fd);
+		pending_fd = -1;
+		uplink_try(pending_idx + 1);
+		return;
+	}
+	fcntl(pending_fd, F_SETFL, 0);
+	oldfd = ufd;
+	ufd = pending_fd;
+	memcpy(&uplink_addr, &uplink_addrs[pending_idx], uplink_addrlens[pending_idx]);
+	uplink_addrlen = uplink_addrlens[pending_idx];
+	pending_fd = -1;
+	uplink_failed = 0;
+	if (oldfd >= 0)
+		close(oldfd);
+	printf("Uplink connected to %s (%s).\n", uplink_res.host,
+				ais_addr_string((struct sockaddr *)&uplink_addr, uplink_addrlen,
+								abuf, sizeof(abuf)));
+}
+
+/*
+ *
+ */
+void
+tcp_write(char *bufp, int nbytes)
+{
+	if (ufd < 0)
+		return;
+	if (write(ufd, bufp, nbytes) != nbytes) {
+		perror("ais_read (tcp_write)");
 		exit(1);
 	}
 }
@@ -379,5 +1047,15 @@ void
 usage()
 {
 	fprintf(stderr, "Usage: ais_read -l <device> -s <speed> -h <host> -p <port> -d <datadir>\n");
+	fprintf(stderr, "       ais_read -r <speed> -h <host> -p <port> -d <datadir> <logfile> ...\n");
+	fprintf(stderr, "Options: -m <shmname> publish to a shared-memory ring (-D to add decoded records)\n");
+	fprintf(stderr, "         -i <secs> re-resolve the uplink host every so often\n");
+	fprintf(stderr, "         -T <metres> only send positions which dead reckoning can't predict\n");
+	fprintf(stderr, "         -A <miles>,<mins>[,<range>] report vessels closing to within <miles> in <mins>\n");
+	fprintf(stderr, "            (searching <range> miles around each, or as far as %.0f knots closing could matter)\n",
+						AIS_CPA_CLOSING);
+	fprintf(stderr, "         -S <dir> keep hourly receiver statistics (-P <lat>,<lon> for range)\n");
+	fprintf(stderr, "         -t <name> frame the uplink with TAG blocks (source, sequence, time)\n");
+	fprintf(stderr, "         -L low-latency serial, with microsecond receive times in the log\n");
 	exit(2);
 }
@@ -48,23 +48,64 @@
 #include <netinet/in.h>
 #include <arpa/inet.h>
 #include <netdb.h>
-#include <sys/select.h>
+#include <sys/epoll.h>
 #include <string.h>
+#include <errno.h>
+#include <signal.h>
 
-#define BUFFER_SIZE		512
+#include "ais.h"
+#include "ais_ring.h"
+#include "ais_resolve.h"
+#include "ais_seq.h"
+#include "relay.h"
 
 struct ais_dest {
-	struct ais_dest	*next;
-	int				fd;
-	char			*host;
-	int				port;
+	struct ais_dest			*next;
+	int						fd;
+	char					*host;
+	int						port;
+	struct ais_resolve		res;
+	struct sockaddr_storage	addr;
+	socklen_t				addrlen;
 };
 
 int				src_fd;
+int				epfd;
+struct ais_resolver	resolver;
+struct ais_resolve	src_res;
 char			buffer[BUFFER_SIZE];
 unsigned long	msg_count;
 struct ais_dest	*dlist;
+struct nmea_parser	parser;
+struct ais_ring		*ring;
+int				decode;
+int				stats_on;
 
+/*
+ * TAG block framing. If we have a tag name, every sentence we pass on
+ * is re-framed with our own name, sequence number and receive time.
+ * Lines the parser won't take (other talkers, bad checksums) are
+ * passed on as they came, without a tag. Whatever comes in tagged is
+ * accounted for, either way.
+ */
+char			*tag_name;
+unsigned long	tag_seq;
+long long		rx_ms;
+char			tag_buffer[BUFFER_SIZE * 4];
+int				tag_len;
+int				tag_framed;
+struct ais_seqtab	seqtab;
+
+void	udp_read();
+void	tag_frame(char *, int);
+void	relay_send(char *, int);
+char	*split_host(char *, int *);
+void	resolve_done();
+void	src_bind(struct ais_resolve *);
+void	dest_connect(struct ais_dest *);
+void	ais_data(void *, char *, int);
+void	ais_message(void *, struct ais_msg *, struct ais_record *);
+long long	ring_stamp();
 void	usage();
 
 /*
@@ -73,57 +114,90 @@ void	usage();
 int
 main(int argc, char *argv[])
 {
-	int i, src_port;
-	char *src_host, *cp;
-	struct hostent *hp;
-	struct sockaddr_in sin;
-	in_addr_t addr;
+	int i, n, src_port, tcp_port, histsize, maxlag, replay_secs, interval;
+	char *src_host, *shmname;
 	struct ais_dest *adp, *dtail;
-	time_t now;
-	struct tm *tmp;
+	time_t now, last_tick, last_report;
+	struct epoll_event ev, events[MAXEVENTS];
+
+	opterr = 0;
+	decode = 0;
+	shmname = NULL;
+	tcp_port = 0;
+	histsize = 4096;
+	maxlag = replay_secs = 0;
+	interval = AIS_RESOLVE_INTERVAL;
+	while ((i = getopt(argc, argv, "m:Dl:H:L:R:i:S:t:")) != EOF) {
+		switch (i) {
+		case 't':
+			if (strlen(optarg) >= NMEA_TAG_SRCLEN || strpbrk(optarg, ",*\\!") != NULL)
+				usage();
+			tag_name = optarg;
+			break;
+
+		case 'S':
+			stats_open(optarg);
+			stats_on = 1;
+			break;
+
+		case 'i':
+			interval = atoi(optarg);
+			break;
+
+		case 'l':
+			if ((tcp_port = atoi(optarg)) < 1 || tcp_port > 65535)
+				usage();
+			break;
+
+		case 'H':
+			if ((histsize = atoi(optarg)) < 1)
+				usage();
+			break;
 
-	if (argc < 3)
+		case 'L':
+			maxlag = atoi(optarg);
+			break;
+
+		case 'R':
+			replay_secs = atoi(optarg);
+			break;
+
+		case 'm':
+			shmname = optarg;
+			break;
+
+		case 'D':
+			decode = 1;
+			break;
+
+		default:
+			usage();
+			break;
+		}
+	}
+	if (argc - optind < (tcp_port > 0 ? 1 : 2) || (decode && shmname == NULL))
 		usage();
-	dlist = dtail = NULL;
-	src_host = argv[1];
-	if ((cp = strchr(src_host, ':')) != NULL) {
-		*cp++ = '\0';
-		src_port = atoi(cp);
-	} else
-		src_port = 4321;
-	printf("SRC: %s - %d\n", src_host, src_port);
 	/*
-	 * Open a UDP port for listening...
+	 * Names are resolved in the background, so nothing here waits
+	 * for DNS. The source is bound as soon as its address is known,
+	 * and each destination is connected (and re-connected, if its
+	 * address changes) whenever it resolves.
 	 */
-	if ((addr = inet_addr(src_host)) == INADDR_NONE) {
-		/*
-		 * Deal with some weird DNS issues.
-		 */
-		for (i = 0; i < 5; i++)
-			if ((hp = gethostbyname(src_host)) != NULL)
-				break;
-		if (hp == NULL) {
-			fprintf(stderr, "?Error - unresolved hostname: '%s'\n", src_host);
-			exit(2);
-		}
-		memcpy((char *)&addr, hp->h_addr, hp->h_length);
-	}
-	if ((src_fd = socket(PF_INET, SOCK_DGRAM, IPPROTO_UDP)) < 0) {
-		perror("ais_relay (udp_open)");
-		exit(1);
-	}
-	memset(&sin, 0, sizeof(struct sockaddr_in));
-	sin.sin_family = AF_INET;
-	sin.sin_addr.s_addr = addr;
-	sin.sin_port = htons(src_port);
-	if (bind(src_fd, (const struct sockaddr *)&sin, sizeof(struct sockaddr_in)) < 0) {
-		perror("ais_relay (bind)");
+	if (ais_resolver_init(&resolver, interval) < 0) {
+		perror("ais_relay (resolver)");
 		exit(1);
 	}
+	dlist = dtail = NULL;
+	src_fd = -1;
+	src_port = 4321;
+	src_host = split_host(argv[optind++], &src_port);
+	printf("SRC: %s - %d\n", src_host, src_port);
+	ais_resolver_add(&resolver, &src_res, src_host, src_port, SOCK_DGRAM,
+						AIS_RESOLVE_PASSIVE, NULL);
 	/*
 	 * Now create all of the destinations...
 	 */
-	for (i = 2; i < argc; i++) {
+	for (i = optind; i < argc; i++) {
 		if ((adp = (struct ais_dest *)malloc(sizeof(*adp))) == NULL) {
 			perror("ais_relay: malloc");
 			exit(1);
@@ -134,65 +208,363 @@ main(int argc, char *argv[])
 		else
 			dtail->next = adp;
 		dtail = adp;
-		adp->host = strdup(argv[i]);
-		if ((cp = strchr(adp->host, ':')) != NULL) {
-			*cp++ = '\0';
-			adp->port = atoi(cp);
-		} else
-			adp->port = 2500;
+		adp->fd = -1;
+		adp->port = 2500;
+		adp->host = split_host(strdup(argv[i]), &adp->port);
 		printf("DSTn: %s - %d\n", adp->host, adp->port);
-		/*
-		 * Open a connection to the destination...
-		 */
-		if ((addr = inet_addr(adp->host)) == INADDR_NONE) {
-			if ((hp = gethostbyname(adp->host)) == NULL) {
-				fprintf(stderr, "?Error - unresolved hostname: %s\n", adp->host);
-				exit(2);
-			}
-			memcpy((char *)&addr, hp->h_addr, hp->h_length);
-		}
-		if ((adp->fd = socket(PF_INET, SOCK_DGRAM, IPPROTO_UDP)) < 0) {
-			perror("ais_relay (udp_open)");
+		ais_resolver_add(&resolver, &adp->res, adp->host, adp->port, SOCK_DGRAM,
+							AIS_RESOLVE_REPEAT, adp);
+	}
+	/*
+	 * Publish what we relay to local consumers, if asked.
+	 */
+	ring = NULL;
+	if (shmname != NULL) {
+		printf("Opening shared memory ring [%s]...\n", shmname);
+		if ((ring = ais_ring_create(shmname, AIS_RING_NSLOTS)) == NULL) {
+			fprintf(stderr, "ais_relay (ring): ");
+			perror(shmname);
 			exit(1);
 		}
-		memset(&sin, 0, sizeof(struct sockaddr_in));
-		sin.sin_family = AF_INET;
-		sin.sin_addr.s_addr = addr;
-		sin.sin_port = htons(adp->port);
-		if (connect(adp->fd, (const struct sockaddr *)&sin, sizeof(struct sockaddr_in)) < 0) {
-			fprintf(stderr, "ais_relay: %s (port %d): ", adp->host, adp->port);
-			perror("connect");
+	}
+	msg_count = 0L;
+	nmea_init(&parser, ais_data, (decode || stats_on) ? ais_message : NULL, NULL);
+	/*
+	 * Everything is driven from epoll. The source socket, and the
+	 * TCP server and its clients, if there are any.
+	 */
+	signal(SIGPIPE, SIG_IGN);
+	if ((epfd = epoll_create1(0)) < 0) {
+		perror("ais_relay (epoll_create)");
+		exit(1);
+	}
+	ev.events = EPOLLIN;
+	ev.data.ptr = &resolver;
+	if (epoll_ctl(epfd, EPOLL_CTL_ADD, ais_resolver_fd(&resolver), &ev) < 0) {
+		perror("ais_relay (epoll_ctl)");
+		exit(1);
+	}
+	if (tcp_port > 0)
+		server_open(tcp_port, histsize * 1024, maxlag * 1024, replay_secs);
+	last_tick = last_report = time(NULL);
+	while (1) {
+		if ((now = time(NULL)) != last_tick) {
+			ais_resolver_tick(&resolver, now);
+			last_tick = now;
+		}
+		if (now - last_report >= SEQ_REPORT) {
+			ais_seq_print(&seqtab, stdout);
+			fflush(stdout);
+			last_report = now;
+		}
+		if ((n = epoll_wait(epfd, events, MAXEVENTS, 1000)) < 0) {
+			if (errno == EINTR)
+				continue;
+			perror("ais_relay (epoll_wait)");
 			exit(1);
 		}
+		for (i = 0; i < n; i++) {
+			if (events[i].data.ptr == &src_fd)
+				udp_read();
+			else if (events[i].data.ptr == &resolver)
+				resolve_done();
+			else
+				server_event(events[i].data.ptr, events[i].events);
+		}
+		if (tcp_port > 0)
+			server_flush();
+		if (stats_on)
+			stats_check(now);
 	}
-	msg_count = 0L;
-	while ((i = read(src_fd, buffer, BUFFER_SIZE)) >= 0) {
+}
+
+/*
+ * Read whatever datagrams are waiting, and relay each of them.
+ */
+void
+udp_read()
+{
+	int i;
+	time_t now;
+	struct tm *tmp;
+	struct sockaddr_storage from;
+	struct timeval tv;
+	socklen_t fromlen;
+
+	fromlen = sizeof(from);
+	while ((i = recvfrom(src_fd, buffer, BUFFER_SIZE, 0,
+							(struct sockaddr *)&from, &fromlen)) >= 0) {
+		/*
+		 * Validate (and publish) what we're relaying. The
+		 * datagram is passed along untouched either way.
+		 */
+		if (stats_on)
+			stats_source((struct sockaddr *)&from, fromlen);
+		gettimeofday(&tv, NULL);
+		rx_ms = tv.tv_sec * 1000LL + tv.tv_usec / 1000;
+		tag_len = 0;
+		if (tag_name == NULL) {
+			nmea_feed(&parser, buffer, i);
+			nmea_flush(&parser);
+		} else
+			tag_frame(buffer, i);
 		if ((++msg_count % 10L) == 0) {
 			time(&now);
 			tmp = localtime(&now);
-			printf("%04d-%02d-%02d %02d:%02d:%02d: %ld packets relayed.\n",
+			printf("%04d-%02d-%02d %02d:%02d:%02d: %ld packets relayed (%lu sentences, %lu bad).\n",
 							tmp->tm_year + 1900, tmp->tm_mon + 1,
 							tmp->tm_mday, tmp->tm_hour, tmp->tm_min,
-							tmp->tm_sec, msg_count);
-		}
-		for (adp = dlist; adp != NULL; adp = adp->next) {
-			if (write(adp->fd, buffer, i) < 0) {
-				fprintf(stderr, "ais_relay: %s (port %d): ", adp->host, adp->port);
-				perror("udp write");
-				exit(1);
-			}
+							tmp->tm_sec, msg_count, parser.nsentences,
+							parser.nbadcsum + parser.nerrors);
 		}
+		if (tag_name == NULL)
+			relay_send(buffer, i);
+		else if (tag_len > 0)
+			relay_send(tag_buffer, tag_len);
+		fromlen = sizeof(from);
 	}
+	if (errno == EAGAIN || errno == EINTR)
+		return;
 	perror("ais_relay (udp read)");
 	exit(1);
 }
 
+/*
+ * Pass a datagram on to every destination, and to any subscribers.
+ */
+void
+relay_send(char *bufp, int len)
+{
+	struct ais_dest *adp;
+
+	for (adp = dlist; adp != NULL; adp = adp->next) {
+		if (adp->fd < 0)
+			continue;
+		if (write(adp->fd, bufp, len) < 0) {
+			fprintf(stderr, "ais_relay: %s (port %d): ", adp->host, adp->port);
+			perror("udp write");
+			exit(1);
+		}
+	}
+	server_append(bufp, len);
+}
+
+/*
+ * Split "host:port" (or "[v6addr]:port") into its parts. The port is
+ * left alone if there isn't one.
+ */
+char *
+split_host(char *strp, int *portp)
+{
+	char *cp;
+
+	if (*strp == '[' && (cp = strchr(strp, ']')) != NULL) {
+		*cp++ = '\0';
+		if (*cp == ':')
+			*portp = atoi(cp + 1);
+		return(strp + 1);
+	}
+	if ((cp = strchr(strp, ':')) != NULL && strchr(cp + 1, ':') == NULL) {
+		*cp++ = '\0';
+		*portp = atoi(cp);
+	}
+	return(strp);
+}
+
+/*
+ * Pick up the results of any lookups.
+ */
+void
+resolve_done()
+{
+	struct ais_resolve *rp;
+
+	while ((rp = ais_resolver_next(&resolver)) != NULL) {
+		if (rp->status != 0) {
+			fprintf(stderr, "?Error - unresolved hostname: %s (%s)\n",
+							rp->host, gai_strerror(rp->status));
+			continue;
+		}
+		if (rp == &src_res)
+			src_bind(rp);
+		else
+			dest_connect((struct ais_dest *)rp->arg);
+	}
+}
+
+/*
+ * Open a UDP port for listening, now that we know the address.
+ */
+void
+src_bind(struct ais_resolve *rp)
+{
+	int i, fd = -1;
+	char abuf[64];
+	struct epoll_event ev;
+
+	if (src_fd >= 0)
+		return;
+	for (i = 0; i < rp->naddrs; i++) {
+		if ((fd = socket(rp->addrs[i].ss_family, SOCK_DGRAM|SOCK_NONBLOCK, IPPROTO_UDP)) < 0)
+			continue;
+		if (bind(fd, (struct sockaddr *)&rp->addrs[i], rp->addrlens[i]) == 0)
+			break;
+		close(fd);
+	}
+	if (i == rp->naddrs) {
+		perror("ais_relay (bind)");
+		exit(1);
+	}
+	src_fd = fd;
+	printf("SRC: bound to %s\n", ais_addr_string((struct sockaddr *)&rp->addrs[i],
+								rp->addrlens[i], abuf, sizeof(abuf)));
+	ev.events = EPOLLIN;
+	ev.data.ptr = &src_fd;
+	if (epoll_ctl(epfd, EPOLL_CTL_ADD, src_fd, &ev) < 0) {
+		perror("ais_relay (epoll_ctl)");
+		exit(1);
+	}
+}
+
+/*
+ * A destination has (re-)resolved. If it's still at the address we're
+ * using, there's nothing to do. Otherwise connect a new socket and
+ * swap it in. The packet loop is on this same thread, so it only
+ * ever sees the old socket or the new one.
+ */
+void
+dest_connect(struct ais_dest *adp)
+{
+	int i, fd = -1, oldfd;
+	char abuf[64];
+	struct ais_resolve *rp = &adp->res;
+
+	if (adp->fd >= 0 && ais_resolve_has(rp, (struct sockaddr *)&adp->addr, adp->addrlen))
+		return;
+	for (i = 0; i < rp->naddrs; i++) {
+		if ((fd = socket(rp->addrs[i].ss_family, SOCK_DGRAM, IPPROTO_UDP)) < 0)
+			continue;
+		if (connect(fd, (struct sockaddr *)&rp->addrs[i], rp->addrlens[i]) == 0)
+			break;
+		close(fd);
+	}
+	if (i == rp->naddrs) {
+		fprintf(stderr, "ais_relay: %s (port %d): ", adp->host, adp->port);
+		perror("connect");
+		return;
+	}
+	memcpy(&adp->addr, &rp->addrs[i], rp->addrlens[i]);
+	adp->addrlen = rp->addrlens[i];
+	printf("DST: %s - %d is at %s\n", adp->host, adp->port,
+				ais_addr_string((struct sockaddr *)&adp->addr, adp->addrlen,
+								abuf, sizeof(abuf)));
+	oldfd = adp->fd;
+	adp->fd = fd;
+	if (oldfd >= 0)
+		close(oldfd);
+}
+
+/*
+ * Re-frame a datagram a line at a time, so that any line which doesn't
+ * come out of the parser as a sentence can be passed on untouched.
+ */
+void
+tag_frame(char *datap, int len)
+{
+	int n;
+	char *cp, *endp = datap + len;
+
+	for (; datap < endp; datap = cp) {
+		if ((cp = memchr(datap, '\n', endp - datap)) != NULL)
+			cp++;
+		else
+			cp = endp;
+		tag_framed = 0;
+		nmea_feed(&parser, datap, cp - datap);
+		nmea_flush(&parser);
+		if (tag_framed)
+			continue;
+		for (n = cp - datap; n > 0 && (datap[n - 1] == '\n' || datap[n - 1] == '\r'); n--)
+			;
+		if (n == 0)
+			continue;
+		if (tag_len + n + 2 > sizeof(tag_buffer)) {
+			relay_send(tag_buffer, tag_len);
+			tag_len = 0;
+		}
+		memcpy(tag_buffer + tag_len, datap, n);
+		tag_len += n;
+		tag_buffer[tag_len++] = '\r';
+		tag_buffer[tag_len++] = '\n';
+	}
+}
+
+/*
+ * Deal with a validated sentence. Account for its TAG block, if it had
+ * one, and if we're framing, add it to the outgoing datagram with our
+ * own. Then publish it to the shared-memory ring, and count it.
+ */
+void
+ais_data(void *arg, char *datap, int len)
+{
+	int n;
+
+	if (parser.tag.flags != 0)
+		ais_seq_update(&seqtab, &parser.tag, rx_ms);
+	if (tag_name != NULL) {
+		if (tag_len + NMEA_TAG_MAXLEN + len + 2 > sizeof(tag_buffer)) {
+			relay_send(tag_buffer, tag_len);
+			tag_len = 0;
+		}
+		if ((n = nmea_tag_build(tag_buffer + tag_len, NMEA_TAG_MAXLEN,
+										tag_name, tag_seq + 1, rx_ms)) > 0) {
+			tag_seq++;
+			tag_framed = 1;
+			tag_len += n;
+			memcpy(tag_buffer + tag_len, datap, len);
+			tag_len += len;
+			tag_buffer[tag_len++] = '\r';
+			tag_buffer[tag_len++] = '\n';
+		}
+	}
+	if (ring != NULL)
+		ais_ring_put(ring, AIS_RING_SENTENCE, datap, len, ring_stamp());
+	if (stats_on)
+		stats_sentence();
+}
+
+/*
+ * Publish a decoded message to the shared-memory ring, and count it.
+ */
+void
+ais_message(void *arg, struct ais_msg *ap, struct ais_record *rp)
+{
+	if (decode)
+		ais_ring_put(ring, AIS_RING_RECORD, rp, sizeof(*rp), ring_stamp());
+	if (stats_on)
+		stats_record(rp);
+}
+
+/*
+ * Timestamp for a ring entry, in microseconds since the epoch.
+ */
+long long
+ring_stamp()
+{
+	struct timeval tv;
+
+	gettimeofday(&tv, NULL);
+	return(tv.tv_sec * 1000000LL + tv.tv_usec);
+}
+
 /*
  *
  */
 void
 usage()
 {
-	fprintf(stderr, "Usage: ais_relay <src_host> <dst_host1> ...\n");
+	fprintf(stderr, "Usage: ais_relay [-m <shmname> [-D]] [-l <tcp_port> [-H <history_kb>] [-L <maxlag_kb>] [-R <replay_secs>]]\n");
+	fprintf(stderr, "                 [-i <resolve_secs>] [-S <stats_dir>] [-t <tag_name>]\n");
+	fprintf(stderr, "                 <src_host> <dst_host1> ...\n");
 	exit(2);
 }
@@ -0,0 +1,390 @@
+/*
+ * Copyright (c) 2021, Kalopa Robotics Limited.  All rights reserved.
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. All advertising materials mentioning features or use of this
+ *    software must display the following acknowledgement:
+ *      "This product includes software developed by Kalopa Robotics
+ *      Limited."
+ *
+ * 4. The name of Kalopa Robotics must not be used to endorse or promote
+ *    products derived from this software without specific prior written
+ *    permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY KALOPA ROBOTICS LIMITED "AS IS" AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL KALOPA ROBOTICS LIMITED
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY,
+ * OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * ABSTRACT
+ * TCP subscriber server for the relay. Everything relayed is appended
+ * to a single in-memory history ring, and each subscriber just has a
+ * cursor into it. Data goes straight from the ring to the socket, so
+ * there is no per-client copy. A client which falls too far behind is
+ * disconnected rather than allowed to hold anything up.
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/epoll.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include "ais_resolve.h"
+#include "ais_pool.h"
+#include "relay.h"
+
+#define INDEX_SIZE		4096
+
+struct client {
+	struct client		*next;
+	struct client		*prev;
+	int					fd;
+	int					blocked;
+	unsigned long long	cursor;
+	char				name[64];
+};
+
+/*
+ * A note of where in the history each second starts, so we can find
+ * the data for "the last N seconds".
+ */
+struct hist_index {
+	time_t				when;
+	unsigned long long	pos;
+};
+
+static int					listen_fd;
+static char					*hist_buf;
+static unsigned long long	hist_head;
+static unsigned long long	hist_size;
+static unsigned long long	max_lag;
+static int					replay_secs;
+static struct hist_index	hist_index[INDEX_SIZE];
+static int					index_head;
+static struct client		*clist;
+static struct ais_pool		client_pool;
+static int					nclients;
+static unsigned long		ndropped;
+
+static void	server_accept();
+static void	client_write(struct client *);
+static void	client_close(struct client *, char *);
+static unsigned long long	replay_start();
+
+/*
+ * Open the listening socket, and allocate the history ring. The
+ * history size is rounded up to a power of two, and the maximum lag
+ * can't be more than the history (less a datagram, for safety).
+ */
+void
+server_open(int port, int histsize, int maxlag, int secs)
+{
+	int on = 1, off = 0;
+	struct sockaddr_in sin;
+	struct sockaddr_in6 sin6;
+	struct epoll_event ev;
+
+	for (hist_size = 1; hist_size < histsize; hist_size <<= 1)
+		;
+	if (maxlag <= 0 || maxlag > hist_size - BUFFER_SIZE)
+		max_lag = hist_size - BUFFER_SIZE;
+	else
+		max_lag = maxlag;
+	replay_secs = secs;
+	printf("TCP server on port %d (history %lluK, max lag %lluK, replay %ds)\n",
+				port, hist_size / 1024, max_lag / 1024, replay_secs);
+	if ((hist_buf = malloc(hist_size)) == NULL) {
+		perror("ais_relay: malloc");
+		exit(1);
+	}
+	hist_head = 0;
+	index_head = 0;
+	memset(hist_index, 0, sizeof(hist_index));
+	clist = NULL;
+	ais_pool_init(&client_pool, sizeof(struct client), 64);
+	/*
+	 * Listen on IPv6 and IPv4 both, if the kernel will let us, or
+	 * just IPv4 if not.
+	 */
+	if ((listen_fd = socket(PF_INET6, SOCK_STREAM|SOCK_NONBLOCK, IPPROTO_TCP)) >= 0) {
+		setsockopt(listen_fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+		setsockopt(listen_fd, IPPROTO_IPV6, IPV6_V6ONLY, &off, sizeof(off));
+		memset(&sin6, 0, sizeof(struct sockaddr_in6));
+		sin6.sin6_family = AF_INET6;
+		sin6.sin6_addr = in6addr_any;
+		sin6.sin6_port = htons(port);
+		if (bind(listen_fd, (const struct sockaddr *)&sin6, sizeof(struct sockaddr_in6)) < 0) {
+			close(listen_fd);
+			listen_fd = -1;
+		}
+	}
+	if (listen_fd < 0) {
+		if ((listen_fd = socket(PF_INET, SOCK_STREAM|SOCK_NONBLOCK, IPPROTO_TCP)) < 0) {
+			perror("ais_relay (tcp socket)");
+			exit(1);
+		}
+		setsockopt(listen_fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+		memset(&sin, 0, sizeof(struct sockaddr_in));
+		sin.sin_family = AF_INET;
+		sin.sin_addr.s_addr = INADDR_ANY;
+		sin.sin_port = htons(port);
+		if (bind(listen_fd, (const struct sockaddr *)&sin, sizeof(struct sockaddr_in)) < 0) {
+			perror("ais_relay (tcp bind)");
+			exit(1);
+		}
+	}
+	if (listen(listen_fd, 128) < 0) {
+		perror("ais_relay (tcp listen)");
+		exit(1);
+	}
+	ev.events = EPOLLIN;
+	ev.data.ptr = &listen_fd;
+	if (epoll_ctl(epfd, EPOLL_CTL_ADD, listen_fd, &ev) < 0) {
+		perror("ais_relay (epoll_ctl)");
+		exit(1);
+	}
+}
+
+/*
+ * Add a datagram to the history.
+ */
+void
+server_append(char *datap, int len)
+{
+	unsigned long long off, n;
+	time_t now;
+
+	if (hist_buf == NULL)
+		return;
+	time(&now);
+	if (hist_index[index_head].when != now) {
+		index_head = (index_head + 1) % INDEX_SIZE;
+		hist_index[index_head].when = now;
+		hist_index[index_head].pos = hist_head;
+	}
+	off = hist_head & (hist_size - 1);
+	if ((n = hist_size - off) > len)
+		n = len;
+	memcpy(hist_buf + off, datap, n);
+	if (n < len)
+		memcpy(hist_buf, datap + n, len - n);
+	hist_head += len;
+}
+
+/*
+ * Push any new data out to all the clients that can take it. A client
+ * which has stopped reading sits blocked, so it's checked for lag here
+ * as well, or it would never be dropped.
+ */
+void
+server_flush()
+{
+	struct client *cp, *ncp;
+
+	for (cp = clist; cp != NULL; cp = ncp) {
+		ncp = cp->next;
+		if (hist_head - cp->cursor > max_lag) {
+			ndropped++;
+			client_close(cp, "fell too far behind");
+		} else if (!cp->blocked && cp->cursor < hist_head)
+			client_write(cp);
+	}
+}
+
+/*
+ * Deal with an epoll event, either on the listening socket or on one
+ * of the clients.
+ */
+void
+server_event(void *ptr, unsigned int events)
+{
+	int n;
+	char junk[BUFFER_SIZE];
+	struct client *cp;
+	struct epoll_event ev;
+
+	if (ptr == &listen_fd) {
+		server_accept();
+		return;
+	}
+	cp = (struct client *)ptr;
+	if (events & (EPOLLERR|EPOLLHUP)) {
+		client_close(cp, "hung up");
+		return;
+	}
+	if (events & EPOLLIN) {
+		/*
+		 * Clients have nothing to say, but we need to notice
+		 * when they go away.
+		 */
+		if ((n = read(cp->fd, junk, sizeof(junk))) == 0 ||
+						(n < 0 && errno != EAGAIN && errno != EINTR)) {
+			client_close(cp, "disconnected");
+			return;
+		}
+	}
+	if ((events & EPOLLOUT) && cp->blocked) {
+		cp->blocked = 0;
+		ev.events = EPOLLIN;
+		ev.data.ptr = cp;
+		epoll_ctl(epfd, EPOLL_CTL_MOD, cp->fd, &ev);
+		client_write(cp);
+	}
+}
+
+/*
+ * Accept as many new clients as are waiting.
+ */
+static void
+server_accept()
+{
+	int fd;
+	socklen_t slen;
+	struct sockaddr_storage addr;
+	struct client *cp;
+	struct epoll_event ev;
+
+	while (1) {
+		slen = sizeof(addr);
+		if ((fd = accept4(listen_fd, (struct sockaddr *)&addr, &slen, SOCK_NONBLOCK)) < 0) {
+			if (errno != EAGAIN && errno != EINTR && errno != ECONNABORTED)
+				perror("ais_relay (accept)");
+			return;
+		}
+		if ((cp = (struct client *)ais_pool_get(&client_pool)) == NULL) {
+			perror("ais_relay: malloc");
+			close(fd);
+			return;
+		}
+		cp->fd = fd;
+		cp->blocked = 0;
+		cp->cursor = replay_start();
+		ais_addr_string((struct sockaddr *)&addr, slen, cp->name, sizeof(cp->name));
+		ev.events = EPOLLIN;
+		ev.data.ptr = cp;
+		if (epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &ev) < 0) {
+			perror("ais_relay (epoll_ctl)");
+			close(fd);
+			ais_pool_put(&client_pool, cp);
+			continue;
+		}
+		cp->prev = NULL;
+		if ((cp->next = clist) != NULL)
+			clist->prev = cp;
+		clist = cp;
+		nclients++;
+		printf("Client %s connected (%d clients).\n", cp->name, nclients);
+		if (cp->cursor < hist_head)
+			client_write(cp);
+	}
+}
+
+/*
+ * Write as much as the client will take, straight out of the history.
+ */
+static void
+client_write(struct client *cp)
+{
+	int n;
+	unsigned long long off, len;
+	struct epoll_event ev;
+
+	while (cp->cursor < hist_head) {
+		if (hist_head - cp->cursor > max_lag) {
+			ndropped++;
+			client_close(cp, "fell too far behind");
+			return;
+		}
+		off = cp->cursor & (hist_size - 1);
+		if ((len = hist_head - cp->cursor) > hist_size - off)
+			len = hist_size - off;
+		if ((n = write(cp->fd, hist_buf + off, len)) < 0) {
+			if (errno == EINTR)
+				continue;
+			if (errno != EAGAIN) {
+				client_close(cp, "write failed");
+				return;
+			}
+			n = 0;
+		}
+		cp->cursor += n;
+		if (n < len) {
+			/*
+			 * Socket is full. Wait until it isn't.
+			 */
+			cp->blocked = 1;
+			ev.events = EPOLLIN|EPOLLOUT;
+			ev.data.ptr = cp;
+			epoll_ctl(epfd, EPOLL_CTL_MOD, cp->fd, &ev);
+			return;
+		}
+	}
+}
+
+/*
+ *
+ */
+static void
+client_close(struct client *cp, char *why)
+{
+	close(cp->fd);
+	if (cp->prev != NULL)
+		cp->prev->next = cp->next;
+	else
+		clist = cp->next;
+	if (cp->next != NULL)
+		cp->next->prev = cp->prev;
+	nclients--;
+	printf("Client %s %s (%d clients, %lu dropped).\n", cp->name, why, nclients, ndropped);
+	ais_pool_put(&client_pool, cp);
+}
+
+/*
+ * Work out where a new client should start reading. Normally that's
+ * the current head, but it can be the last few seconds of history so
+ * that the client is warmed up straight away.
+ */
+static unsigned long long
+replay_start()
+{
+	int i, n;
+	unsigned long long start, oldest;
+	time_t since;
+
+	if (replay_secs <= 0 || hist_head == 0)
+		return(hist_head);
+	since = time(NULL) - replay_secs;
+	oldest = hist_head > max_lag ? hist_head - max_lag : 0;
+	start = hist_head;
+	for (i = index_head, n = 0; n < INDEX_SIZE; n++) {
+		if (hist_index[i].when < since || hist_index[i].pos < oldest)
+			break;
+		start = hist_index[i].pos;
+		i = (i + INDEX_SIZE - 1) % INDEX_SIZE;
+	}
+	return(start);
+}
@@ -0,0 +1,189 @@
+/*
+ * Copyright (c) 2021, Kalopa Robotics Limited.  All rights reserved.
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. All advertising materials mentioning features or use of this
+ *    software must display the following acknowledgement:
+ *      "This product includes software developed by Kalopa Robotics
+ *      Limited."
+ *
+ * 4. The name of Kalopa Robotics must not be used to endorse or promote
+ *    products derived from this software without specific prior written
+ *    permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY KALOPA ROBOTICS LIMITED "AS IS" AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL KALOPA ROBOTICS LIMITED
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY,
+ * OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * ABSTRACT
+ * Per-receiver statistics for the relay. Receivers are told apart by
+ * the address their datagrams come from. There's a fixed number of
+ * slots, so memory stays the same however many turn up - any extras
+ * are lumped together as "other". Every hour the summaries go into
+ * the day's stats file, and a SIGUSR1 prints them as they stand.
+ */
+#include <stdio.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <time.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+
+#include "ais.h"
+#include "ais_resolve.h"
+#include "ais_stats.h"
+#include "relay.h"
+
+#define MAXRX			16
+
+char				*statsdir;
+struct ais_stats	*rx_stats[MAXRX];
+struct ais_stats	*cur_stats;
+int					nrx;
+long				window;
+volatile sig_atomic_t	stats_query;
+
+void	stats_signal(int);
+void	stats_write();
+
+/*
+ * Start keeping statistics, with the hourly summaries in the given
+ * directory.
+ */
+void
+stats_open(char *dir)
+{
+	statsdir = dir;
+	window = time(NULL);
+	window -= window % AIS_STATS_WINDOW;
+	signal(SIGUSR1, stats_signal);
+}
+
+/*
+ * The next lot of data came from this address. Find (or make) the
+ * statistics for it.
+ */
+void
+stats_source(struct sockaddr *sap, socklen_t len)
+{
+	int i;
+	char abuf[AIS_STATS_NAMELEN];
+
+	ais_addr_string(sap, len, abuf, sizeof(abuf));
+	for (i = 0; i < nrx; i++) {
+		if (strcmp(rx_stats[i]->name, abuf) == 0) {
+			cur_stats = rx_stats[i];
+			return;
+		}
+	}
+	if (nrx == MAXRX) {
+		cur_stats = rx_stats[MAXRX - 1];
+		return;
+	}
+	if ((cur_stats = (struct ais_stats *)malloc(sizeof(struct ais_stats))) == NULL) {
+		perror("ais_relay: malloc");
+		exit(1);
+	}
+	ais_stats_init(cur_stats, nrx == MAXRX - 1 ? "other" : abuf, time(NULL));
+	rx_stats[nrx++] = cur_stats;
+	printf("STATS: new receiver %s\n", cur_stats->name);
+}
+
+/*
+ * Count a sentence or a decoded message from the current source.
+ */
+void
+stats_sentence()
+{
+	if (cur_stats != NULL)
+		ais_stats_sentence(cur_stats);
+}
+
+void
+stats_record(struct ais_record *rp)
+{
+	if (cur_stats != NULL)
+		ais_stats_record(cur_stats, rp);
+}
+
+/*
+ * Deal with any query, and write out the summaries at the end of each
+ * window.
+ */
+void
+stats_check(long now)
+{
+	int i;
+
+	if (stats_query) {
+		stats_query = 0;
+		for (i = 0; i < nrx; i++)
+			ais_stats_print(rx_stats[i], stdout);
+		fflush(stdout);
+	}
+	if (now < window + AIS_STATS_WINDOW)
+		return;
+	stats_write();
+	window = now - now % AIS_STATS_WINDOW;
+	for (i = 0; i < nrx; i++)
+		ais_stats_reset(rx_stats[i], now);
+}
+
+/*
+ * SIGUSR1 asks for the statistics so far.
+ */
+void
+stats_signal(int sig)
+{
+	stats_query = 1;
+}
+
+/*
+ * Append the summaries for this window to the day's stats file.
+ */
+void
+stats_write()
+{
+	int i;
+	char fpath[512];
+	time_t when = window;
+	struct tm *tmp;
+	FILE *fp;
+
+	if (nrx == 0)
+		return;
+	tmp = localtime(&when);
+	snprintf(fpath, sizeof(fpath), "%s/%04d%02d%02d", statsdir,
+					tmp->tm_year + 1900, tmp->tm_mon + 1, tmp->tm_mday);
+	if (ais_make_path(fpath) < 0) {
+		perror(fpath);
+		return;
+	}
+	strncat(fpath, "/stats.log", sizeof(fpath) - strlen(fpath) - 1);
+	if ((fp = fopen(fpath, "a")) == NULL) {
+		perror(fpath);
+		return;
+	}
+	for (i = 0; i < nrx; i++)
+		ais_stats_print(rx_stats[i], fp);
+	fclose(fp);
+}
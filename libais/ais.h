@@ -0,0 +1,253 @@
+/*
+ * Copyright (c) 2021, Kalopa Robotics Limited.  All rights reserved.
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. All advertising materials mentioning features or use of this
+ *    software must display the following acknowledgement:
+ *      "This product includes software developed by Kalopa Robotics
+ *      Limited."
+ *
+ * 4. The name of Kalopa Robotics must not be used to endorse or promote
+ *    products derived from this software without specific prior written
+ *    permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY KALOPA ROBOTICS LIMITED "AS IS" AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL KALOPA ROBOTICS LIMITED
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY,
+ * OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * ABSTRACT
+ * Definitions for the AIS/NMEA parsing library. The parser is fed raw
+ * bytes and calls back with each validated sentence, and with each
+ * fully-assembled and decoded AIS message. All of the state lives in
+ * the caller's struct nmea_parser, so there is one per input stream
+ * (or per thread) and nothing is allocated on the way through.
+ */
+#ifndef _AIS_H_
+#define _AIS_H_
+
+#define NMEA_MAXLINE		512
+#define NMEA_MAXARGS		32
+#define NMEA_NSLOTS			4
+
+#define AIS_MAXARMOUR		360
+#define AIS_MAXPAYLOAD		((AIS_MAXARMOUR * 6 + 7) / 8)
+
+#define MSGTYPE_VDM			0
+#define MSGTYPE_VDO			1
+
+#define MSG_POSREP_A			1
+#define MSG_POSREP_A_ASSIGNED	2
+#define MSG_POSREP_A_RESPONSE	3
+#define MSG_BASE_STN_REPORT		4
+#define MSG_STATIC_VOYAGE_DATA	5
+#define MSG_BINARY_ADDRMSG		6
+#define MSG_BINARY_ACK			7
+#define MSG_BINARY_BCAST		8
+#define MSG_SAR_POSREP			9
+#define MSG_UTC_DATE_INQ		10
+#define MSG_UTC_DATE_RESP		11
+#define MSG_SAFETY_MSG			12
+#define MSG_SAFETY_ACK			13
+#define MSG_SAFETY_BCAST		14
+#define MSG_INTERROGATION		15
+#define MSG_ASSIGNMENT_MODE		16
+#define MSG_DGNSS_BCAST			17
+#define MSG_POSREP_B_CS			18
+#define MSG_POSREP_B_EQUIP		19
+#define MSG_LINK_MGMT			20
+#define MSG_AID_TO_NAV			21
+#define MSG_CHANNEL_MGMT		22
+#define MSG_GROUP_ASSIGN		23
+#define MSG_STATIC_DATA			24
+#define MSG_SINGLE_SLOT			25
+#define MSG_MULTI_SLOT			26
+#define MSG_POSREP_LONGRANGE	27
+
+#define NAV_AT_ANCHOR		1
+#define NAV_NOT_UNDER_CMD	2
+#define NAV_RESTRICTED		3
+#define NAV_CONSTRAINED		4
+#define NAV_MOORED			5
+#define NAV_AGROUND			6
+#define NAV_FISHING			7
+#define NAV_UW_SAILING		8
+#define NAV_AIS_SART		14
+#define NAV_UNDEFINED		15
+
+/*
+ * "Not available" values, in the units of struct ais_record.
+ */
+#define AIS_LON_NA			(181 * 600000)
+#define AIS_LAT_NA			(91 * 600000)
+#define AIS_SOG_NA			1023
+#define AIS_COG_NA			3600
+#define AIS_HDG_NA			511
+
+/*
+ * Record flags.
+ */
+#define AIS_HAS_POSITION	0x01
+#define AIS_HAS_MOTION		0x02
+#define AIS_HAS_STATIC		0x04
+
+/*
+ * An assembled AIS message, as binary. The bit reader state is used by
+ * _get_bits() to walk through the payload.
+ */
+struct ais_msg	{
+	int				chan;
+	int				type;
+	int				msg_id;
+	int				nfrags;
+	int				msg_len;
+	int				nbits;
+	unsigned char	message[AIS_MAXPAYLOAD];
+	int				msg_offset;
+	unsigned long long bit_reg;
+	int				bit_count;
+	int				bit_error;
+	char			*raw_src;
+};
+
+/*
+ * The decoded form of an AIS message. Only the common header is
+ * filled in for the message types we don't care about. Latitude and
+ * longitude are in 1/10000 minute, SOG in 1/10 knot and COG in 1/10
+ * degree, whatever the message type.
+ */
+struct ais_record {
+	int				type;
+	int				flags;
+	int				chan;
+	int				repeat;
+	unsigned int	mmsi;
+	int				nav_status;
+	int				rot;
+	int				sog;
+	int				accuracy;
+	int				lon;
+	int				lat;
+	int				cog;
+	int				heading;
+	int				second;
+	int				shiptype;
+	char			name[21];
+};
+
+/*
+ * An NMEA 4.x TAG block ("\s:src,n:seq,c:time*hh\") in front of a
+ * sentence. The standard "c:" is seconds since the epoch, and we add
+ * the milliseconds as a field of our own ("m:"), which anything else
+ * will skip. Some kit sends milliseconds in "c:", and that is taken
+ * too. The time is kept in milliseconds.
+ */
+#define NMEA_TAG_SRC		0x01
+#define NMEA_TAG_SEQ		0x02
+#define NMEA_TAG_TIME		0x04
+
+#define NMEA_TAG_SRCLEN		16
+#define NMEA_TAG_MAXLEN		64
+
+struct nmea_tag {
+	int				flags;
+	char			src[NMEA_TAG_SRCLEN];
+	unsigned long	seq;
+	long long		time_ms;
+};
+
+/*
+ * Fragment reassembly slot, for multi-sentence messages.
+ */
+struct nmea_slot {
+	int				in_use;
+	int				chan;
+	int				msg_id;
+	int				nfrags;
+	int				next_frag;
+	int				armour_len;
+	char			armour[AIS_MAXARMOUR + 1];
+};
+
+struct nmea_parser {
+	char			line[NMEA_MAXLINE + 2];
+	int				offset;
+	int				discard;
+	struct nmea_slot slots[NMEA_NSLOTS];
+	int				next_slot;
+	struct ais_msg	msg;
+	struct ais_record rec;
+	struct nmea_tag	tag;
+	/*
+	 * Receive times, in microseconds. The caller stamps each lot of
+	 * bytes it feeds in, and each line takes the stamp of the lot its
+	 * first byte came in with. Realtime and monotonic both, one for
+	 * the records and one for measuring.
+	 */
+	long long		feed_rt;
+	long long		feed_mono;
+	long long		line_rt;
+	long long		line_mono;
+	/*
+	 * Callbacks, and the argument handed to them.
+	 */
+	void			(*sentence_cb)(void *, char *, int);
+	void			(*message_cb)(void *, struct ais_msg *, struct ais_record *);
+	void			*cb_arg;
+	/*
+	 * Statistics.
+	 */
+	unsigned long	nlines;
+	unsigned long	nsentences;
+	unsigned long	nmessages;
+	unsigned long	nbadcsum;
+	unsigned long	nerrors;
+	unsigned long	noverflow;
+	unsigned long	ntagged;
+	unsigned long	nbadtag;
+};
+
+/*
+ * nmea.c
+ */
+void	nmea_init(struct nmea_parser *,
+				void (*)(void *, char *, int),
+				void (*)(void *, struct ais_msg *, struct ais_record *),
+				void *);
+void	nmea_feed(struct nmea_parser *, const char *, int);
+void	nmea_flush(struct nmea_parser *);
+void	nmea_stamp(struct nmea_parser *, long long, long long);
+int		nmea_tag_parse(const char *, struct nmea_tag *);
+int		nmea_tag_build(char *, int, const char *, unsigned long, long long);
+int		nmea_sentence(struct nmea_parser *, char *);
+int		nmea_checksum(const char *, const char **);
+int		nmea_logline(const char *, char *, int);
+int		crack(char *, char *[], int);
+int		to_int(char *, int);
+
+/*
+ * ais_decode.c
+ */
+int				ais_armour(struct ais_msg *, const char *, int, int);
+unsigned int	_get_bits(struct ais_msg *, int);
+int				_get_sbits(struct ais_msg *, int);
+int				ais_decode(struct ais_msg *, struct ais_record *);
+int				ais_decode_generic(struct ais_msg *, struct ais_record *);
+
+#endif /* _AIS_H_ */
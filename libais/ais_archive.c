@@ -0,0 +1,660 @@
+/*
+ * Copyright (c) 2021, Kalopa Robotics Limited.  All rights reserved.
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. All advertising materials mentioning features or use of this
+ *    software must display the following acknowledgement:
+ *      "This product includes software developed by Kalopa Robotics
+ *      Limited."
+ *
+ * 4. The name of Kalopa Robotics must not be used to endorse or promote
+ *    products derived from this software without specific prior written
+ *    permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY KALOPA ROBOTICS LIMITED "AS IS" AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL KALOPA ROBOTICS LIMITED
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY,
+ * OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * ABSTRACT
+ * Write and read the columnar daily archive.
+ */
+#include <stdio.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+
+#include "ais.h"
+#include "ais_pool.h"
+#include "ais_archive.h"
+
+/*
+ * The columns in each group.
+ */
+static int	group_cols[AIS_NGROUPS][AIS_NCOLS + 1] = {
+	{AIS_COL_MMSI, AIS_COL_TIME, AIS_COL_LAT, AIS_COL_LON, AIS_COL_SOG,
+		AIS_COL_COG, AIS_COL_HDG, AIS_COL_TYPE, AIS_COL_NAVSTAT, -1},
+	{AIS_COL_MMSI, AIS_COL_TIME, AIS_COL_LAT, AIS_COL_LON, AIS_COL_TYPE, -1},
+	{AIS_COL_MMSI, AIS_COL_TIME, AIS_COL_TYPE, AIS_COL_SHIPTYPE, AIS_COL_NAME, -1},
+	{AIS_COL_MMSI, AIS_COL_TIME, AIS_COL_TYPE, -1}
+};
+
+static int			_reccmp(const void *, const void *);
+static int			_uintcmp(const void *, const void *);
+static int			_block_end(struct ais_arec *, int, int);
+static int			_field(struct ais_arec *, int);
+static int			_is_delta(int);
+static int			_encode(struct ais_arec *, int, int, unsigned int *, int, char *,
+														unsigned char *);
+static unsigned char	*_put_varint(unsigned char *, unsigned int);
+static unsigned char	*_get_varint(unsigned char *, unsigned char *, unsigned int *);
+static void			_put32(unsigned char *, unsigned int);
+static void			_put64(unsigned char *, unsigned long long);
+static unsigned int	_get32(unsigned char *);
+static unsigned long long	_get64(unsigned char *);
+
+#define ZIGZAG(v)		(((unsigned int )(v) << 1) ^ (unsigned int )((v) >> 31))
+#define UNZIGZAG(u)		((int )((u) >> 1) ^ -(int )((u) & 1))
+
+/*
+ * Which column group does a message type belong in?
+ */
+int
+ais_arc_group(int type)
+{
+	switch (type) {
+	case MSG_POSREP_A:
+	case MSG_POSREP_A_ASSIGNED:
+	case MSG_POSREP_A_RESPONSE:
+	case MSG_SAR_POSREP:
+	case MSG_POSREP_B_CS:
+	case MSG_POSREP_B_EQUIP:
+	case MSG_POSREP_LONGRANGE:
+		return(AIS_GRP_POSITION);
+
+	case MSG_BASE_STN_REPORT:
+	case MSG_UTC_DATE_RESP:
+	case MSG_AID_TO_NAV:
+		return(AIS_GRP_FIXED);
+
+	case MSG_STATIC_VOYAGE_DATA:
+	case MSG_STATIC_DATA:
+		return(AIS_GRP_STATIC);
+	}
+	return(AIS_GRP_OTHER);
+}
+
+/*
+ * Write a day's worth of records to an archive file. The records are
+ * sorted in place. Returns -1 (with errno set) on failure.
+ */
+int
+ais_arc_write(char *path, int day, struct ais_arec *recs, int nrecs, char *names)
+{
+	int i, j, k, c, ndict, nblocks, len;
+	unsigned long long off, dict_off, index_off;
+	unsigned int *dict;
+	unsigned char *bufp, *cp, hdr[AIS_ARC_HDRSIZE];
+	struct ais_ablock *blocks, *bp;
+	struct ais_arec *rp;
+	struct ais_arena arena;
+	FILE *fp;
+
+	for (i = 0; i < nrecs; i++)
+		recs[i].group = ais_arc_group(recs[i].type);
+	qsort(recs, nrecs, sizeof(*recs), _reccmp);
+	/*
+	 * Build the MMSI dictionary, in ascending order. It and all of the
+	 * working space come out of one arena, freed in one go.
+	 */
+	ais_arena_init(&arena, 0);
+	if ((dict = ais_arena_alloc(&arena, (nrecs + 1) * sizeof(*dict))) == NULL)
+		return(-1);
+	for (i = 0; i < nrecs; i++)
+		dict[i] = recs[i].mmsi;
+	qsort(dict, nrecs, sizeof(*dict), _uintcmp);
+	for (i = ndict = 0; i < nrecs; i++)
+		if (ndict == 0 || dict[ndict - 1] != dict[i])
+			dict[ndict++] = dict[i];
+	/*
+	 * Count the blocks rather than guess from the hours in a day. A
+	 * leap second (or a stray timestamp) can land outside them.
+	 */
+	for (i = nblocks = 0; i < nrecs; i = _block_end(recs, i, nrecs))
+		nblocks++;
+	blocks = ais_arena_alloc(&arena, nblocks * sizeof(*blocks));
+	bufp = ais_arena_alloc(&arena, (ndict + AIS_ARC_BLOCKSIZE) * 24 +
+							nblocks * (AIS_ARC_BLKSIZE + AIS_NCOLS * AIS_ARC_COLSIZE));
+	if (blocks == NULL || bufp == NULL || (fp = fopen(path, "w")) == NULL) {
+		ais_arena_free(&arena);
+		return(-1);
+	}
+	memset(hdr, 0, sizeof(hdr));
+	fwrite(hdr, sizeof(hdr), 1, fp);
+	off = AIS_ARC_HDRSIZE;
+	/*
+	 * Cut the records into blocks, and write out each column of each
+	 * block in turn.
+	 */
+	for (i = nblocks = 0; i < nrecs; i = j) {
+		rp = &recs[i];
+		j = _block_end(recs, i, nrecs);
+		bp = &blocks[nblocks++];
+		memset(bp, 0, sizeof(*bp));
+		bp->group = rp->group;
+		bp->nrecs = j - i;
+		bp->tmin = bp->latmin = bp->lonmin = 0x7fffffff;
+		bp->tmax = bp->latmax = bp->lonmax = -0x7fffffff;
+		bp->mmsimin = rp->mmsi;
+		bp->mmsimax = recs[j - 1].mmsi;
+		for (k = i; k < j; k++) {
+			if (recs[k].time < bp->tmin)
+				bp->tmin = recs[k].time;
+			if (recs[k].time > bp->tmax)
+				bp->tmax = recs[k].time;
+			if (recs[k].lat == AIS_LAT_NA || recs[k].lon == AIS_LON_NA)
+				continue;
+			if (recs[k].lat < bp->latmin)
+				bp->latmin = recs[k].lat;
+			if (recs[k].lat > bp->latmax)
+				bp->latmax = recs[k].lat;
+			if (recs[k].lon < bp->lonmin)
+				bp->lonmin = recs[k].lon;
+			if (recs[k].lon > bp->lonmax)
+				bp->lonmax = recs[k].lon;
+		}
+		for (c = 0; (k = group_cols[bp->group][c]) >= 0; c++) {
+			len = _encode(rp, j - i, k, dict, ndict, names, bufp);
+			fwrite(bufp, len, 1, fp);
+			bp->cols[c] = k;
+			bp->col_off[c] = off;
+			bp->col_len[c] = len;
+			off += len;
+		}
+		bp->ncols = c;
+	}
+	/*
+	 * The dictionary, as deltas.
+	 */
+	dict_off = off;
+	for (i = 0, cp = bufp; i < ndict; i++)
+		cp = _put_varint(cp, i == 0 ? dict[0] : dict[i] - dict[i - 1]);
+	fwrite(bufp, cp - bufp, 1, fp);
+	off += cp - bufp;
+	/*
+	 * The block index.
+	 */
+	index_off = off;
+	for (i = 0, cp = bufp; i < nblocks; i++) {
+		bp = &blocks[i];
+		memset(cp, 0, AIS_ARC_BLKSIZE);
+		cp[0] = bp->group;
+		cp[1] = bp->ncols;
+		_put32(cp + 4, bp->nrecs);
+		_put32(cp + 8, bp->tmin);
+		_put32(cp + 12, bp->tmax);
+		_put32(cp + 16, bp->latmin);
+		_put32(cp + 20, bp->latmax);
+		_put32(cp + 24, bp->lonmin);
+		_put32(cp + 28, bp->lonmax);
+		_put32(cp + 32, bp->mmsimin);
+		_put32(cp + 36, bp->mmsimax);
+		cp += AIS_ARC_BLKSIZE;
+		for (c = 0; c < bp->ncols; c++) {
+			memset(cp, 0, AIS_ARC_COLSIZE);
+			cp[0] = bp->cols[c];
+			_put32(cp + 4, bp->col_len[c]);
+			_put64(cp + 8, bp->col_off[c]);
+			cp += AIS_ARC_COLSIZE;
+		}
+	}
+	fwrite(bufp, cp - bufp, 1, fp);
+	/*
+	 * Finally, go back and fill in the header.
+	 */
+	_put32(hdr, AIS_ARC_MAGIC);
+	_put32(hdr + 4, AIS_ARC_VERSION);
+	_put32(hdr + 8, day);
+	_put32(hdr + 12, nrecs);
+	_put32(hdr + 16, ndict);
+	_put32(hdr + 20, nblocks);
+	_put64(hdr + 24, dict_off);
+	_put64(hdr + 32, index_off);
+	fseek(fp, 0L, SEEK_SET);
+	fwrite(hdr, sizeof(hdr), 1, fp);
+	ais_arena_free(&arena);
+	if (ferror(fp)) {
+		fclose(fp);
+		return(-1);
+	}
+	return(fclose(fp));
+}
+
+/*
+ * Open an archive, and read in the dictionary and the block index.
+ * Nothing in the index is trusted: the counts have to fit in the space
+ * they came from, no block can hold more than AIS_ARC_BLOCKSIZE records,
+ * and every column has to lie within the file, or the open fails.
+ */
+struct ais_archive *
+ais_arc_open(char *path)
+{
+	int i, c;
+	unsigned int val;
+	unsigned long long dict_off, index_off, size, fsize;
+	unsigned char hdr[AIS_ARC_HDRSIZE], *bufp, *cp, *endp;
+	struct ais_archive *ap;
+	struct ais_ablock *bp;
+
+	if ((ap = malloc(sizeof(*ap))) == NULL)
+		return(NULL);
+	memset(ap, 0, sizeof(*ap));
+	ais_arena_init(&ap->arena, 0);
+	errno = 0;
+	if ((ap->fd = open(path, O_RDONLY)) < 0 ||
+				pread(ap->fd, hdr, sizeof(hdr), 0) != sizeof(hdr) ||
+				_get32(hdr) != AIS_ARC_MAGIC || _get32(hdr + 4) != AIS_ARC_VERSION)
+		goto fail;
+	ap->day = _get32(hdr + 8);
+	ap->nrecs = _get32(hdr + 12);
+	ap->ndict = _get32(hdr + 16);
+	ap->nblocks = _get32(hdr + 20);
+	dict_off = _get64(hdr + 24);
+	index_off = _get64(hdr + 32);
+	if ((fsize = lseek(ap->fd, 0, SEEK_END)) < index_off || index_off < dict_off ||
+				dict_off < AIS_ARC_HDRSIZE)
+		goto fail;
+	size = fsize - dict_off;
+	/*
+	 * Every dictionary entry takes at least a byte, and every block
+	 * entry at least AIS_ARC_BLKSIZE.
+	 */
+	if (ap->nrecs < 0 || ap->ndict < 0 || ap->nblocks < 0 ||
+				ap->ndict > index_off - dict_off ||
+				ap->nblocks > (fsize - index_off) / AIS_ARC_BLKSIZE)
+		goto fail;
+	ap->dict = malloc((ap->ndict + 1) * sizeof(*ap->dict));
+	ap->blocks = malloc((ap->nblocks + 1) * sizeof(*ap->blocks));
+	if (ap->dict == NULL || ap->blocks == NULL ||
+				(bufp = ais_arena_alloc(&ap->arena, size)) == NULL ||
+				pread(ap->fd, bufp, size, dict_off) != size)
+		goto fail;
+	ap->bytes_read = sizeof(hdr) + size;
+	endp = bufp + (index_off - dict_off);
+	for (i = 0, cp = bufp; i < ap->ndict; i++) {
+		if ((cp = _get_varint(cp, endp, &val)) == NULL)
+			goto fail;
+		ap->dict[i] = i == 0 ? val : ap->dict[i - 1] + val;
+	}
+	endp = bufp + size;
+	for (i = 0, cp = bufp + (index_off - dict_off); i < ap->nblocks; i++) {
+		bp = &ap->blocks[i];
+		if (cp + AIS_ARC_BLKSIZE > endp || cp[0] >= AIS_NGROUPS || cp[1] > AIS_NCOLS ||
+					cp + AIS_ARC_BLKSIZE + cp[1] * AIS_ARC_COLSIZE > endp)
+			goto fail;
+		bp->group = cp[0];
+		bp->ncols = cp[1];
+		bp->nrecs = _get32(cp + 4);
+		if (bp->nrecs < 0 || bp->nrecs > AIS_ARC_BLOCKSIZE)
+			goto fail;
+		bp->tmin = _get32(cp + 8);
+		bp->tmax = _get32(cp + 12);
+		bp->latmin = _get32(cp + 16);
+		bp->latmax = _get32(cp + 20);
+		bp->lonmin = _get32(cp + 24);
+		bp->lonmax = _get32(cp + 28);
+		bp->mmsimin = _get32(cp + 32);
+		bp->mmsimax = _get32(cp + 36);
+		cp += AIS_ARC_BLKSIZE;
+		for (c = 0; c < bp->ncols; c++) {
+			bp->cols[c] = cp[0];
+			bp->col_len[c] = _get32(cp + 4);
+			bp->col_off[c] = _get64(cp + 8);
+			if (bp->cols[c] >= AIS_NCOLS || bp->col_off[c] > fsize || bp->col_len[c] > fsize - bp->col_off[c])
+				goto fail;
+			cp += AIS_ARC_COLSIZE;
+		}
+	}
+	ais_arena_reset(&ap->arena);
+	return(ap);
+
+fail:
+	if (ap->fd >= 0)
+		close(ap->fd);
+	ais_arena_free(&ap->arena);
+	free(ap->dict);
+	free(ap->blocks);
+	free(ap);
+	if (errno == 0)
+		errno = EINVAL;
+	return(NULL);
+}
+
+/*
+ *
+ */
+void
+ais_arc_close(struct ais_archive *ap)
+{
+	close(ap->fd);
+	ais_arena_free(&ap->arena);
+	free(ap->dict);
+	free(ap->blocks);
+	free(ap);
+}
+
+/*
+ * Read and decode one column of a block into an array of nrecs values
+ * (never more than AIS_ARC_BLOCKSIZE, as the open checked).
+ * The delta-encoded columns need the (already decoded) MMSI column to
+ * tell where each vessel starts. Returns -1 if the block doesn't have
+ * that column, or it's corrupt. The raw column is read into the
+ * archive's arena, which is reset each time.
+ */
+int
+ais_arc_column(struct ais_archive *ap, struct ais_ablock *bp, int col, int *vals, int *mmsis)
+{
+	int i, c, n, prev;
+	unsigned int val, count, idx;
+	unsigned char *bufp, *cp, *endp;
+
+	for (c = 0; c < bp->ncols; c++)
+		if (bp->cols[c] == col)
+			break;
+	if (c == bp->ncols || col == AIS_COL_NAME || (_is_delta(col) && mmsis == NULL))
+		return(-1);
+	ais_arena_reset(&ap->arena);
+	if ((bufp = ais_arena_alloc(&ap->arena, bp->col_len[c] + 1)) == NULL ||
+				pread(ap->fd, bufp, bp->col_len[c], bp->col_off[c]) != bp->col_len[c])
+		return(-1);
+	ap->bytes_read += bp->col_len[c];
+	endp = bufp + bp->col_len[c];
+	cp = bufp;
+	if (col == AIS_COL_MMSI) {
+		/*
+		 * Runs of (dictionary index delta, count). Both are checked
+		 * against what's left before they're used, so that nothing
+		 * can wrap.
+		 */
+		for (i = idx = 0; i < bp->nrecs;) {
+			if ((cp = _get_varint(cp, endp, &val)) == NULL ||
+						(cp = _get_varint(cp, endp, &count)) == NULL ||
+						val >= (unsigned int )ap->ndict - idx ||
+						count > (unsigned int )(bp->nrecs - i))
+				break;
+			idx += val;
+			for (n = 0; n < count; n++)
+				vals[i++] = ap->dict[idx];
+		}
+	} else {
+		for (i = prev = 0; i < bp->nrecs; i++) {
+			if ((cp = _get_varint(cp, endp, &val)) == NULL)
+				break;
+			if (!_is_delta(col))
+				vals[i] = val;
+			else {
+				if (i == 0 || mmsis[i] != mmsis[i - 1])
+					prev = 0;
+				vals[i] = prev = prev + UNZIGZAG(val);
+			}
+		}
+	}
+	return(i == bp->nrecs ? 0 : -1);
+}
+
+/*
+ * Read the names column of a block.
+ */
+int
+ais_arc_names(struct ais_archive *ap, struct ais_ablock *bp, char (*names)[21])
+{
+	int i, c;
+	unsigned int len;
+	unsigned char *bufp, *cp, *endp;
+
+	for (c = 0; c < bp->ncols; c++)
+		if (bp->cols[c] == AIS_COL_NAME)
+			break;
+	if (c == bp->ncols)
+		return(-1);
+	ais_arena_reset(&ap->arena);
+	if ((bufp = ais_arena_alloc(&ap->arena, bp->col_len[c] + 1)) == NULL ||
+				pread(ap->fd, bufp, bp->col_len[c], bp->col_off[c]) != bp->col_len[c])
+		return(-1);
+	ap->bytes_read += bp->col_len[c];
+	endp = bufp + bp->col_len[c];
+	for (i = 0, cp = bufp; i < bp->nrecs; i++) {
+		if ((cp = _get_varint(cp, endp, &len)) == NULL || len > 20 || cp + len > endp)
+			break;
+		memcpy(names[i], cp, len);
+		names[i][len] = '\0';
+		cp += len;
+	}
+	return(i == bp->nrecs ? 0 : -1);
+}
+
+/*
+ * Encode one column for a run of records. Returns the length.
+ */
+static int
+_encode(struct ais_arec *rp, int n, int col, unsigned int *dict, int ndict,
+											char *names, unsigned char *bufp)
+{
+	int i, k, prev, val;
+	unsigned int *dp, last;
+	unsigned char *cp;
+	char *strp;
+
+	cp = bufp;
+	switch (col) {
+	case AIS_COL_MMSI:
+		/*
+		 * The records are in MMSI order, so this is a list of
+		 * (dictionary index delta, count) pairs.
+		 */
+		for (i = 0, last = 0; i < n; i = k) {
+			for (k = i + 1; k < n && rp[k].mmsi == rp[i].mmsi; k++)
+				;
+			dp = bsearch(&rp[i].mmsi, dict, ndict, sizeof(*dict), _uintcmp);
+			cp = _put_varint(cp, (dp - dict) - last);
+			cp = _put_varint(cp, k - i);
+			last = dp - dict;
+		}
+		break;
+
+	case AIS_COL_NAME:
+		for (i = 0; i < n; i++) {
+			strp = rp[i].name >= 0 ? names + rp[i].name : "";
+			k = strlen(strp);
+			cp = _put_varint(cp, k);
+			memcpy(cp, strp, k);
+			cp += k;
+		}
+		break;
+
+	default:
+		for (i = prev = 0; i < n; i++) {
+			val = _field(&rp[i], col);
+			if (!_is_delta(col))
+				cp = _put_varint(cp, val);
+			else {
+				if (i == 0 || rp[i].mmsi != rp[i - 1].mmsi)
+					prev = 0;
+				cp = _put_varint(cp, ZIGZAG(val - prev));
+				prev = val;
+			}
+		}
+		break;
+	}
+	return(cp - bufp);
+}
+
+/*
+ *
+ */
+static int
+_field(struct ais_arec *rp, int col)
+{
+	switch (col) {
+	case AIS_COL_TIME:
+		return(rp->time);
+	case AIS_COL_LAT:
+		return(rp->lat);
+	case AIS_COL_LON:
+		return(rp->lon);
+	case AIS_COL_SOG:
+		return(rp->sog);
+	case AIS_COL_COG:
+		return(rp->cog);
+	case AIS_COL_HDG:
+		return(rp->heading);
+	case AIS_COL_TYPE:
+		return(rp->type);
+	case AIS_COL_NAVSTAT:
+		return(rp->nav_status);
+	case AIS_COL_SHIPTYPE:
+		return(rp->shiptype);
+	}
+	return(0);
+}
+
+/*
+ * Columns which are stored as deltas within each vessel.
+ */
+static int
+_is_delta(int col)
+{
+	return(col == AIS_COL_TIME || col == AIS_COL_LAT || col == AIS_COL_LON ||
+				col == AIS_COL_SOG || col == AIS_COL_COG || col == AIS_COL_HDG);
+}
+
+/*
+ * Sort by group, hour, MMSI and time.
+ */
+static int
+_reccmp(const void *a, const void *b)
+{
+	const struct ais_arec *ap = a, *bp = b;
+
+	if (ap->group != bp->group)
+		return(ap->group - bp->group);
+	if (ap->time / 3600 != bp->time / 3600)
+		return(ap->time / 3600 - bp->time / 3600);
+	if (ap->mmsi != bp->mmsi)
+		return(ap->mmsi < bp->mmsi ? -1 : 1);
+	return(ap->time - bp->time);
+}
+
+/*
+ * Where does the block starting at record i end? Blocks hold a single
+ * group and hour, and no more than AIS_ARC_BLOCKSIZE records.
+ */
+static int
+_block_end(struct ais_arec *recs, int i, int nrecs)
+{
+	int j;
+
+	for (j = i + 1; j < nrecs && j - i < AIS_ARC_BLOCKSIZE; j++)
+		if (recs[j].group != recs[i].group || recs[j].time / 3600 != recs[i].time / 3600)
+			break;
+	return(j);
+}
+
+/*
+ *
+ */
+static int
+_uintcmp(const void *a, const void *b)
+{
+	unsigned int av = *(const unsigned int *)a, bv = *(const unsigned int *)b;
+
+	return(av < bv ? -1 : (av > bv ? 1 : 0));
+}
+
+/*
+ * Unsigned LEB128-style varints.
+ */
+static unsigned char *
+_put_varint(unsigned char *cp, unsigned int val)
+{
+	while (val >= 0x80) {
+		*cp++ = (val & 0x7f) | 0x80;
+		val >>= 7;
+	}
+	*cp++ = val;
+	return(cp);
+}
+
+/*
+ *
+ */
+static unsigned char *
+_get_varint(unsigned char *cp, unsigned char *endp, unsigned int *valp)
+{
+	int shift;
+
+	for (*valp = 0, shift = 0; cp < endp && shift < 35; shift += 7) {
+		*valp |= (unsigned int )(*cp & 0x7f) << shift;
+		if ((*cp++ & 0x80) == 0)
+			return(cp);
+	}
+	return(NULL);
+}
+
+/*
+ * Little-endian integers, for the header and index.
+ */
+static void
+_put32(unsigned char *cp, unsigned int val)
+{
+	cp[0] = val;
+	cp[1] = val >> 8;
+	cp[2] = val >> 16;
+	cp[3] = val >> 24;
+}
+
+/*
+ *
+ */
+static void
+_put64(unsigned char *cp, unsigned long long val)
+{
+	_put32(cp, (unsigned int )val);
+	_put32(cp + 4, (unsigned int )(val >> 32));
+}
+
+/*
+ *
+ */
+static unsigned int
+_get32(unsigned char *cp)
+{
+	return(cp[0] | cp[1] << 8 | cp[2] << 16 | (unsigned int )cp[3] << 24);
+}
+
+/*
+ *
+ */
+static unsigned long long
+_get64(unsigned char *cp)
+{
+	return(_get32(cp) | (unsigned long long )_get32(cp + 4) << 32);
+}
@@ -0,0 +1,139 @@
+/*
+ * Copyright (c) 2021, Kalopa Robotics Limited.  All rights reserved.
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. All advertising materials mentioning features or use of this
+ *    software must display the following acknowledgement:
+ *      "This product includes software developed by Kalopa Robotics
+ *      Limited."
+ *
+ * 4. The name of Kalopa Robotics must not be used to endorse or promote
+ *    products derived from this software without specific prior written
+ *    permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY KALOPA ROBOTICS LIMITED "AS IS" AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL KALOPA ROBOTICS LIMITED
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY,
+ * OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * ABSTRACT
+ * Columnar daily archive format. A day's decoded records are split
+ * into column groups by message type, and then into blocks (by hour,
+ * and at most AIS_ARC_BLOCKSIZE records each). Within a block the
+ * records are sorted by vessel and time. MMSIs are dictionary-encoded
+ * and run-length encoded, and everything else is zigzag varint
+ * encoded, as a delta from the same vessel's previous record where
+ * that helps. Every block carries min/max statistics, and every column
+ * has its own offset, so a scan only reads the blocks and columns it
+ * needs.
+ *
+ * File layout: header, column data for each block, MMSI dictionary,
+ * block index.
+ */
+#ifndef _AIS_ARCHIVE_H_
+#define _AIS_ARCHIVE_H_
+
+#define AIS_ARC_MAGIC		0x43534941
+#define AIS_ARC_VERSION		1
+#define AIS_ARC_BLOCKSIZE	8192
+#define AIS_ARC_HDRSIZE		40
+#define AIS_ARC_BLKSIZE		40
+#define AIS_ARC_COLSIZE		16
+
+/*
+ * Column groups.
+ */
+#define AIS_GRP_POSITION	0
+#define AIS_GRP_FIXED		1
+#define AIS_GRP_STATIC		2
+#define AIS_GRP_OTHER		3
+#define AIS_NGROUPS			4
+
+/*
+ * Columns.
+ */
+#define AIS_COL_MMSI		0
+#define AIS_COL_TIME		1
+#define AIS_COL_LAT			2
+#define AIS_COL_LON			3
+#define AIS_COL_SOG			4
+#define AIS_COL_COG			5
+#define AIS_COL_HDG			6
+#define AIS_COL_TYPE		7
+#define AIS_COL_NAVSTAT		8
+#define AIS_COL_SHIPTYPE	9
+#define AIS_COL_NAME		10
+#define AIS_NCOLS			11
+
+/*
+ * A record, as it goes into the archive. Time is seconds since
+ * midnight. Names are kept in a separate string table, and name is an
+ * offset into it (or -1).
+ */
+struct ais_arec {
+	unsigned int	mmsi;
+	int				time;
+	int				lat;
+	int				lon;
+	short			sog;
+	short			cog;
+	short			heading;
+	unsigned char	type;
+	unsigned char	nav_status;
+	unsigned char	shiptype;
+	unsigned char	group;
+	int				name;
+};
+
+/*
+ * A block, as described by the index.
+ */
+struct ais_ablock {
+	int				group;
+	int				ncols;
+	int				nrecs;
+	int				tmin, tmax;
+	int				latmin, latmax;
+	int				lonmin, lonmax;
+	unsigned int	mmsimin, mmsimax;
+	int				cols[AIS_NCOLS];
+	unsigned int	col_len[AIS_NCOLS];
+	unsigned long long col_off[AIS_NCOLS];
+};
+
+struct ais_archive {
+	int				fd;
+	int				day;
+	int				nrecs;
+	int				ndict;
+	int				nblocks;
+	unsigned int	*dict;
+	struct ais_ablock *blocks;
+	struct ais_arena arena;
+	unsigned long long bytes_read;
+};
+
+int		ais_arc_group(int);
+int		ais_arc_write(char *, int, struct ais_arec *, int, char *);
+struct ais_archive	*ais_arc_open(char *);
+void	ais_arc_close(struct ais_archive *);
+int		ais_arc_column(struct ais_archive *, struct ais_ablock *, int, int *, int *);
+int		ais_arc_names(struct ais_archive *, struct ais_ablock *, char (*)[21]);
+
+#endif /* _AIS_ARCHIVE_H_ */
@@ -0,0 +1,392 @@
+/*
+ * Copyright (c) 2021, Kalopa Robotics Limited.  All rights reserved.
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. All advertising materials mentioning features or use of this
+ *    software must display the following acknowledgement:
+ *      "This product includes software developed by Kalopa Robotics
+ *      Limited."
+ *
+ * 4. The name of Kalopa Robotics must not be used to endorse or promote
+ *    products derived from this software without specific prior written
+ *    permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY KALOPA ROBOTICS LIMITED "AS IS" AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL KALOPA ROBOTICS LIMITED
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY,
+ * OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * ABSTRACT
+ * Incremental CPA/TCPA collision-risk engine. See ais_cpa.h.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "ais.h"
+#include "ais_pool.h"
+#include "ais_cpa.h"
+
+/*
+ * Metres in one unit (1/10000 minute) of latitude, and the number of
+ * units right around the world.
+ */
+#define UNIT_METRES		0.1852
+#define UNITS_360		(360 * 600000)
+#define KNOT_MS			(1852.0 / 3600.0)
+
+#define CELL_HASH(r, c)	((unsigned int )((r) * 1000003 + (c)) & (AIS_CPA_NCELLS - 1))
+#define PAIR_HASH(a, b)	(((a) * 31 + (b)) & (AIS_CPA_NALERTHASH - 1))
+
+static struct ais_cvessel	*_find(struct ais_cpa *, unsigned int);
+static int	_cell(struct ais_cpa *, int, int, int *, int *);
+static void	_cell_remove(struct ais_cpa *, struct ais_cvessel *);
+static void	_check(struct ais_cpa *, struct ais_cvessel *, struct ais_cvessel *);
+static void	_clear(struct ais_cpa *, struct ais_cpa_alert **, struct ais_cvessel *,
+						struct ais_cvessel *);
+static void	_expire(struct ais_cpa *, int, int);
+
+/*
+ * Set up the engine. The CPA limit and the search range are in metres,
+ * and the TCPA limit in seconds. The range should be comfortably more
+ * than the CPA limit.
+ */
+void
+ais_cpa_init(struct ais_cpa *cp, double cpa_limit, double tcpa_limit, double range,
+				void (*alert)(void *, int, struct ais_cpa_alert *), void *arg)
+{
+	memset(cp, 0, sizeof(*cp));
+	cp->cpa_limit = cpa_limit;
+	cp->tcpa_limit = tcpa_limit;
+	cp->range = range > cpa_limit ? range : cpa_limit * 2.0;
+	cp->maxage = AIS_CPA_MAXAGE;
+	ais_pool_init(&cp->vpool, sizeof(struct ais_cvessel), 1024);
+	ais_pool_init(&cp->apool, sizeof(struct ais_cpa_alert), 0);
+	cp->alert = alert;
+	cp->arg = arg;
+}
+
+/*
+ * The search range needed to catch every pair which could reach the
+ * CPA limit within the TCPA limit, closing at up to AIS_CPA_CLOSING
+ * knots. Never less than the default range.
+ */
+double
+ais_cpa_range(double cpa_limit, double tcpa_limit)
+{
+	double range;
+
+	range = cpa_limit + tcpa_limit * AIS_CPA_CLOSING * KNOT_MS;
+	return(range > AIS_CPA_RANGE ? range : AIS_CPA_RANGE);
+}
+
+/*
+ * A new position report. SOG and COG are in the usual AIS units, and
+ * either can be not-available. The vessel moves to its new cell, and
+ * every vessel in the cells around it is checked. Returns -1 if there's
+ * no room for another vessel.
+ */
+int
+ais_cpa_update(struct ais_cpa *cp, unsigned int mmsi, int now, int lat, int lon,
+				int sog, int cog)
+{
+	int i, j, r, c, row, col, ncols;
+	double speed;
+	struct ais_cvessel *vp, *op, **vpp;
+
+	if ((vp = _find(cp, mmsi)) == NULL) {
+		if (cp->nvessels >= AIS_CPA_MAXVESSELS)
+			return(-1);
+		if ((vp = (struct ais_cvessel *)ais_pool_get(&cp->vpool)) == NULL)
+			return(-1);
+		memset(vp, 0, sizeof(*vp));
+		vp->mmsi = mmsi;
+		vpp = &cp->vessels[mmsi & (AIS_CPA_NHASH - 1)];
+		vp->next = *vpp;
+		*vpp = vp;
+		vp->cell_next = NULL;
+		vp->row = vp->col = -1;
+		cp->nvessels++;
+	}
+	cp->nupdates++;
+	vp->time = now;
+	vp->lat = lat;
+	vp->lon = lon;
+	vp->moving = sog != AIS_SOG_NA && cog != AIS_COG_NA && sog >= AIS_CPA_MINSOG;
+	if (vp->moving) {
+		speed = sog / 10.0 * KNOT_MS;
+		vp->vx = speed * sin(cog / 10.0 * M_PI / 180.0);
+		vp->vy = speed * cos(cog / 10.0 * M_PI / 180.0);
+	} else
+		vp->vx = vp->vy = 0.0;
+	row = -1;
+	_cell(cp, lat, lon, &row, &col);
+	if (row != vp->row || col != vp->col) {
+		if (vp->row >= 0)
+			_cell_remove(cp, vp);
+		vp->row = row;
+		vp->col = col;
+		vpp = &cp->cells[CELL_HASH(row, col)];
+		vp->cell_next = *vpp;
+		*vpp = vp;
+	}
+	/*
+	 * A vessel which isn't going anywhere can only be at risk from
+	 * one that is, and that one will do the checking. Unless of
+	 * course it has just stopped, and has alerts to clear.
+	 */
+	if (!vp->moving && vp->nalerts == 0)
+		return(0);
+	for (i = -1; i <= 1; i++) {
+		if ((r = row + i) < 0)
+			continue;
+		ncols = _cell(cp, lat, lon, &r, &c);
+		for (j = 0; j < 3 && j < ncols; j++) {
+			col = ncols < 3 ? j : (c + j - 1 + ncols) % ncols;
+			for (op = cp->cells[CELL_HASH(r, col)]; op != NULL; op = op->cell_next) {
+				if (op->row == r && op->col == col && op != vp)
+					_check(cp, vp, op);
+			}
+		}
+	}
+	return(0);
+}
+
+/*
+ * Forget about vessels we haven't heard from in a while, and clear any
+ * alerts which haven't been looked at recently.
+ */
+void
+ais_cpa_expire(struct ais_cpa *cp, int now)
+{
+	_expire(cp, now, 0);
+}
+
+/*
+ * Clear every alert and forget about every vessel, and give back the
+ * memory they were using.
+ */
+void
+ais_cpa_flush(struct ais_cpa *cp)
+{
+	_expire(cp, 0, 1);
+	ais_pool_free(&cp->vpool);
+	ais_pool_free(&cp->apool);
+}
+
+/*
+ * Find a vessel by MMSI.
+ */
+static struct ais_cvessel *
+_find(struct ais_cpa *cp, unsigned int mmsi)
+{
+	struct ais_cvessel *vp;
+
+	for (vp = cp->vessels[mmsi & (AIS_CPA_NHASH - 1)]; vp != NULL; vp = vp->next)
+		if (vp->mmsi == mmsi)
+			return(vp);
+	return(NULL);
+}
+
+/*
+ * Work out the grid cell for a position. Rows are bands of latitude a
+ * range high. Each row is cut into as many columns as will fit around
+ * the world at that latitude, so cells are roughly square and wrap at
+ * the date line. If the row is already set (not -1) it's used as is,
+ * to find the column in a neighbouring row. Returns the number of
+ * columns in the row.
+ */
+static int
+_cell(struct ais_cpa *cp, int lat, int lon, int *rowp, int *colp)
+{
+	int ncols;
+	double coslat;
+
+	if (*rowp < 0)
+		*rowp = (int )floor((lat + 90 * 600000) * UNIT_METRES / cp->range);
+	coslat = cos(((*rowp + 0.5) * cp->range / UNIT_METRES - 90 * 600000) *
+					M_PI / (180.0 * 600000.0));
+	if (coslat < 0.001)
+		coslat = 0.001;
+	ncols = (int )ceil(UNITS_360 * UNIT_METRES * coslat / cp->range);
+	*colp = (int )floor((lon + 180 * 600000) * UNIT_METRES * coslat / cp->range);
+	*colp = ((*colp % ncols) + ncols) % ncols;
+	return(ncols);
+}
+
+/*
+ * Take a vessel out of its grid cell.
+ */
+static void
+_cell_remove(struct ais_cpa *cp, struct ais_cvessel *vp)
+{
+	struct ais_cvessel **vpp;
+
+	for (vpp = &cp->cells[CELL_HASH(vp->row, vp->col)]; *vpp != NULL; vpp = &(*vpp)->cell_next) {
+		if (*vpp == vp) {
+			*vpp = vp->cell_next;
+			break;
+		}
+	}
+	vp->cell_next = NULL;
+}
+
+/*
+ * Work out the CPA and TCPA for a pair of vessels, where vp has just
+ * reported and op's last report is dead-reckoned forward to now. Then
+ * raise or clear the alert as needed.
+ */
+static void
+_check(struct ais_cpa *cp, struct ais_cvessel *vp, struct ais_cvessel *op)
+{
+	int risk, dlon;
+	unsigned int m1, m2;
+	double dt, dx, dy, dvx, dvy, dv2, tcpa, cpa, hyst;
+	struct ais_cpa_alert *ap, **app;
+
+	cp->npairs++;
+	risk = 0;
+	cpa = tcpa = 0.0;
+	if ((vp->moving || op->moving) && vp->time - op->time <= cp->maxage) {
+		dt = vp->time - op->time;
+		if ((dlon = op->lon - vp->lon) > UNITS_360 / 2)
+			dlon -= UNITS_360;
+		else if (dlon < -UNITS_360 / 2)
+			dlon += UNITS_360;
+		dy = (op->lat - vp->lat) * UNIT_METRES + op->vy * dt;
+		dx = dlon * UNIT_METRES * cos(vp->lat * M_PI / (180.0 * 600000.0)) + op->vx * dt;
+		dvx = op->vx - vp->vx;
+		dvy = op->vy - vp->vy;
+		if ((dv2 = dvx * dvx + dvy * dvy) > 1e-6) {
+			/*
+			 * If they're already opening, the CPA was in the past
+			 * and is as good as where they are now.
+			 */
+			if ((tcpa = -(dx * dvx + dy * dvy) / dv2) < 0.0)
+				tcpa = 0.0;
+			dx += dvx * tcpa;
+			dy += dvy * tcpa;
+			risk = tcpa > 0.0;
+		}
+		cpa = sqrt(dx * dx + dy * dy);
+	}
+	if (vp->mmsi < op->mmsi) {
+		m1 = vp->mmsi;
+		m2 = op->mmsi;
+	} else {
+		m1 = op->mmsi;
+		m2 = vp->mmsi;
+	}
+	for (app = &cp->alerts[PAIR_HASH(m1, m2)]; (ap = *app) != NULL; app = &ap->next)
+		if (ap->mmsi1 == m1 && ap->mmsi2 == m2)
+			break;
+	/*
+	 * An alert has to get a bit better than the thresholds before
+	 * it's cleared, so it doesn't flap.
+	 */
+	hyst = ap != NULL ? AIS_CPA_HYST : 1.0;
+	risk = risk && cpa <= cp->cpa_limit * hyst && tcpa <= cp->tcpa_limit * hyst;
+	if (ap == NULL) {
+		if (!risk)
+			return;
+		if (cp->nalerts >= AIS_CPA_MAXALERTS ||
+				(ap = (struct ais_cpa_alert *)ais_pool_get(&cp->apool)) == NULL) {
+			cp->nlost++;
+			return;
+		}
+		ap->mmsi1 = m1;
+		ap->mmsi2 = m2;
+		ap->time = vp->time;
+		ap->cpa = cpa;
+		ap->tcpa = tcpa;
+		ap->next = *app;
+		*app = ap;
+		cp->nalerts++;
+		cp->nraised++;
+		vp->nalerts++;
+		op->nalerts++;
+		if (cp->alert != NULL)
+			cp->alert(cp->arg, AIS_CPA_RAISE, ap);
+		return;
+	}
+	ap->time = vp->time;
+	ap->cpa = cpa;
+	ap->tcpa = tcpa;
+	if (!risk)
+		_clear(cp, app, vp, op);
+}
+
+/*
+ * Clear an alert. Either vessel can be NULL if it has gone away.
+ */
+static void
+_clear(struct ais_cpa *cp, struct ais_cpa_alert **app, struct ais_cvessel *vp,
+		struct ais_cvessel *op)
+{
+	struct ais_cpa_alert *ap = *app;
+
+	*app = ap->next;
+	cp->nalerts--;
+	cp->ncleared++;
+	if (vp != NULL)
+		vp->nalerts--;
+	if (op != NULL)
+		op->nalerts--;
+	if (cp->alert != NULL)
+		cp->alert(cp->arg, AIS_CPA_CLEAR, ap);
+	ais_pool_put(&cp->apool, ap);
+}
+
+/*
+ * Clear stale alerts first, while both vessels can still be found, and
+ * then drop the stale vessels. Everything is stale if "all" is set.
+ */
+static void
+_expire(struct ais_cpa *cp, int now, int all)
+{
+	int i;
+	struct ais_cvessel *vp, *op, **vpp;
+	struct ais_cpa_alert *ap, **app;
+
+	for (i = 0; i < AIS_CPA_NALERTHASH; i++) {
+		for (app = &cp->alerts[i]; (ap = *app) != NULL;) {
+			vp = _find(cp, ap->mmsi1);
+			op = _find(cp, ap->mmsi2);
+			if (all || now - ap->time > cp->maxage ||
+					vp == NULL || now - vp->time > cp->maxage ||
+					op == NULL || now - op->time > cp->maxage)
+				_clear(cp, app, vp, op);
+			else
+				app = &ap->next;
+		}
+	}
+	for (i = 0; i < AIS_CPA_NHASH; i++) {
+		for (vpp = &cp->vessels[i]; (vp = *vpp) != NULL;) {
+			if (!all && now - vp->time <= cp->maxage) {
+				vpp = &vp->next;
+				continue;
+			}
+			*vpp = vp->next;
+			_cell_remove(cp, vp);
+			ais_pool_put(&cp->vpool, vp);
+			cp->nvessels--;
+		}
+	}
+}
@@ -0,0 +1,135 @@
+/*
+ * Copyright (c) 2021, Kalopa Robotics Limited.  All rights reserved.
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. All advertising materials mentioning features or use of this
+ *    software must display the following acknowledgement:
+ *      "This product includes software developed by Kalopa Robotics
+ *      Limited."
+ *
+ * 4. The name of Kalopa Robotics must not be used to endorse or promote
+ *    products derived from this software without specific prior written
+ *    permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY KALOPA ROBOTICS LIMITED "AS IS" AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL KALOPA ROBOTICS LIMITED
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY,
+ * OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * ABSTRACT
+ * Incremental CPA/TCPA (closest point of approach, and time to it)
+ * collision-risk engine. Position reports go in, and alerts come out
+ * when a pair of vessels crosses the thresholds, one way or the other.
+ *
+ * Vessels are kept in a spatial hash grid with cells about as big as
+ * the search range, so a report only has to be checked against the
+ * vessels in the nine cells around it. Nothing else is recomputed.
+ */
+#ifndef _AIS_CPA_H_
+#define _AIS_CPA_H_
+
+#define AIS_CPA_NHASH		65536
+#define AIS_CPA_NCELLS		65536
+#define AIS_CPA_NALERTHASH	16384
+#define AIS_CPA_MAXVESSELS	131072
+#define AIS_CPA_MAXALERTS	65536
+#define AIS_CPA_MAXAGE		180
+#define AIS_CPA_MINSOG		10
+#define AIS_CPA_HYST		1.25
+
+#define AIS_CPA_CLEAR		0
+#define AIS_CPA_RAISE		1
+
+/*
+ * Default thresholds - half a mile, twenty minutes, and look six miles
+ * around each vessel.
+ */
+#define AIS_CPA_LIMIT		926.0
+#define AIS_TCPA_LIMIT		1200.0
+#define AIS_CPA_RANGE		11112.0
+
+/*
+ * The fastest two vessels are expected to close on each other, in
+ * knots (two twenty-knot ships, head on). A pair further apart than
+ * this speed times the TCPA limit can't get within the CPA limit in
+ * time, so ais_cpa_range() uses it to size the search.
+ */
+#define AIS_CPA_CLOSING		40.0
+
+/*
+ * What we know about a vessel. The velocity is in metres per second,
+ * east and north.
+ */
+struct ais_cvessel {
+	struct ais_cvessel	*next;
+	struct ais_cvessel	*cell_next;
+	unsigned int		mmsi;
+	int					time;
+	int					lat;
+	int					lon;
+	int					row;
+	int					col;
+	int					moving;
+	int					nalerts;
+	double				vx;
+	double				vy;
+};
+
+/*
+ * A pair of vessels currently in alert. The CPA is in metres and the
+ * TCPA in seconds from the time of the last check.
+ */
+struct ais_cpa_alert {
+	struct ais_cpa_alert	*next;
+	unsigned int			mmsi1;
+	unsigned int			mmsi2;
+	int						time;
+	double					cpa;
+	double					tcpa;
+};
+
+struct ais_cpa {
+	double					cpa_limit;
+	double					tcpa_limit;
+	double					range;
+	int						maxage;
+	int						nvessels;
+	int						nalerts;
+	struct ais_cvessel		*vessels[AIS_CPA_NHASH];
+	struct ais_cvessel		*cells[AIS_CPA_NCELLS];
+	struct ais_cpa_alert	*alerts[AIS_CPA_NALERTHASH];
+	struct ais_pool			vpool;
+	struct ais_pool			apool;
+	void					(*alert)(void *, int, struct ais_cpa_alert *);
+	void					*arg;
+	unsigned long			nupdates;
+	unsigned long			npairs;
+	unsigned long			nraised;
+	unsigned long			ncleared;
+	unsigned long			nlost;
+};
+
+void	ais_cpa_init(struct ais_cpa *, double, double, double,
+						void (*)(void *, int, struct ais_cpa_alert *), void *);
+int		ais_cpa_update(struct ais_cpa *, unsigned int, int, int, int, int, int);
+double	ais_cpa_range(double, double);
+void	ais_cpa_expire(struct ais_cpa *, int);
+void	ais_cpa_flush(struct ais_cpa *);
+
+#endif /* _AIS_CPA_H_ */
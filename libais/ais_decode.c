@@ -0,0 +1,389 @@
+/*
+ * Copyright (c) 2021, Kalopa Robotics Limited.  All rights reserved.
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. All advertising materials mentioning features or use of this
+ *    software must display the following acknowledgement:
+ *      "This product includes software developed by Kalopa Robotics
+ *      Limited."
+ *
+ * 4. The name of Kalopa Robotics must not be used to endorse or promote
+ *    products derived from this software without specific prior written
+ *    permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY KALOPA ROBOTICS LIMITED "AS IS" AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL KALOPA ROBOTICS LIMITED
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY,
+ * OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * ABSTRACT
+ * Decode the binary payload of an AIS message into a struct ais_record.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ais.h"
+
+/*
+ * Position reports make up most of the traffic, and every field in
+ * them sits at a fixed offset. For those, the payload is loaded into
+ * a few 64-bit words, big-endian, and each field is pulled out with
+ * shifts and masks known at compile time. The tables give the bit
+ * offset and width of each field, with U or S for unsigned or signed.
+ */
+#define AIS_HEADER_FIELDS(F) \
+	F(type,			0,		6,	U) \
+	F(repeat,		6,		2,	U) \
+	F(mmsi,			8,		30,	U)
+
+#define AIS_POSREP_A_FIELDS(F) \
+	F(nav_status,	38,		4,	U) \
+	F(rot,			42,		8,	S) \
+	F(sog,			50,		10,	U) \
+	F(accuracy,		60,		1,	U) \
+	F(lon,			61,		28,	S) \
+	F(lat,			89,		27,	S) \
+	F(cog,			116,	12,	U) \
+	F(heading,		128,	9,	U) \
+	F(second,		137,	6,	U)
+
+#define AIS_POSREP_B_FIELDS(F) \
+	F(sog,			46,		10,	U) \
+	F(accuracy,		56,		1,	U) \
+	F(lon,			57,		28,	S) \
+	F(lat,			85,		27,	S) \
+	F(cog,			112,	12,	U) \
+	F(heading,		124,	9,	U) \
+	F(second,		133,	6,	U)
+
+/*
+ * Bytes needed to cover the last field of either report (bit 143).
+ */
+#define AIS_POSREP_BYTES	18
+#define AIS_POSREP_WORDS	3
+
+/*
+ * Left-align the field starting at bit "off" in the top of a 64-bit
+ * value. The second word only comes into it if the field straddles
+ * the boundary, and as "off" and "wid" are constants, so is the test.
+ */
+#define _AIS_ALIGN(w, off, wid) \
+	(((w)[(off) >> 6] << ((off) & 63)) | \
+		(((off) & 63) + (wid) > 64 ? \
+			(w)[((off) >> 6) + 1] >> ((64 - ((off) & 63)) & 63) : 0))
+#define _AIS_U(w, off, wid)	((unsigned int )(_AIS_ALIGN(w, off, wid) >> (64 - (wid))))
+#define _AIS_S(w, off, wid)	((int )((long long )_AIS_ALIGN(w, off, wid) >> (64 - (wid))))
+#define _AIS_FIELD(name, off, wid, sign)	rp->name = _AIS_##sign(w, off, wid);
+
+static int		_decode_posrep(struct ais_msg *, struct ais_record *);
+static void		_get_text(struct ais_msg *, char *, int);
+
+/*
+ * Convert a message from sixbit back to binary, and reset the bit
+ * reader to the start of it.
+ */
+int
+ais_armour(struct ais_msg *ap, const char *armour, int len, int fill)
+{
+	int i, n, ch;
+	unsigned char *xp;
+
+	if (len * 6 - fill < 6 || len > AIS_MAXARMOUR)
+		return(-1);
+	ap->msg_len = 0;
+	for (i = 0, n = 0, xp = ap->message; len-- > 0;) {
+		if ((ch = *armour++ - '0') < 0)
+			return(-1);
+		if (ch > 39) {
+			if (ch < 48)
+				return(-1);
+			ch -= 8;
+			if (ch > 63)
+				return(-1);
+		}
+		i = (i << 6) | ch;
+		if ((n += 6) >= 8) {
+			n -= 8;
+			*xp++ = (i >> n) & 0xff;
+			ap->msg_len++;
+		}
+	}
+	if (n > 0) {
+		*xp++ = (i << (8 - n)) & 0xff;
+		ap->msg_len++;
+	}
+	ap->nbits = ap->msg_len * 8 - (n > 0 ? 8 - n : 0) - fill;
+	ap->msg_offset = ap->bit_count = ap->bit_error = 0;
+	ap->bit_reg = 0;
+	return(0);
+}
+
+/*
+ * Pull the next few bits (up to 32) out of the message. Running off
+ * the end sets the error flag and returns zero.
+ */
+unsigned int
+_get_bits(struct ais_msg *ap, int nbits)
+{
+	while (ap->bit_count < nbits) {
+		if (ap->msg_offset >= ap->msg_len) {
+			ap->bit_error = 1;
+			return(0);
+		}
+		ap->bit_reg = ap->bit_reg << 8 | ap->message[ap->msg_offset++];
+		ap->bit_count += 8;
+	}
+	ap->bit_count -= nbits;
+	return((ap->bit_reg >> ap->bit_count) & ((1ULL << nbits) - 1));
+}
+
+/*
+ * As above, but sign-extend the result.
+ */
+int
+_get_sbits(struct ais_msg *ap, int nbits)
+{
+	unsigned int bval;
+
+	bval = _get_bits(ap, nbits);
+	if (bval & (1U << (nbits - 1)))
+		bval |= ~((1U << (nbits - 1)) - 1);
+	return((int )bval);
+}
+
+/*
+ * Decode a sixbit text field of the given number of characters.
+ * Trailing '@' padding and spaces are dropped.
+ */
+static void
+_get_text(struct ais_msg *ap, char *strp, int nchars)
+{
+	int ch;
+	char *endp;
+
+	for (endp = strp; nchars-- > 0;) {
+		if ((ch = _get_bits(ap, 6)) < 32)
+			ch += 64;
+		*strp++ = ch;
+		if (ch != '@' && ch != ' ')
+			endp = strp;
+	}
+	*endp = '\0';
+}
+
+/*
+ * Decode an assembled message. Returns -1 if the message is too short
+ * for its type. Position reports go through the fixed-offset decoder,
+ * and everything else through the bit reader.
+ */
+int
+ais_decode(struct ais_msg *ap, struct ais_record *rp)
+{
+	if (_decode_posrep(ap, rp) == 0)
+		return(ais_decode_generic(ap, rp));
+	if ((rp->lon > 180 * 600000 || rp->lon < -180 * 600000 ||
+				rp->lat > 90 * 600000 || rp->lat < -90 * 600000))
+		rp->flags &= ~AIS_HAS_POSITION;
+	return(0);
+}
+
+/*
+ * Decode any message type a field at a time with the bit reader.
+ * This is the only path for the rarer types, and is kept callable on
+ * its own so the fast path can be checked against it.
+ */
+int
+ais_decode_generic(struct ais_msg *ap, struct ais_record *rp)
+{
+	rp->flags = 0;
+	rp->chan = ap->chan;
+	rp->nav_status = NAV_UNDEFINED;
+	rp->rot = -128;
+	rp->sog = AIS_SOG_NA;
+	rp->accuracy = 0;
+	rp->lon = AIS_LON_NA;
+	rp->lat = AIS_LAT_NA;
+	rp->cog = AIS_COG_NA;
+	rp->heading = AIS_HDG_NA;
+	rp->second = 60;
+	rp->shiptype = 0;
+	rp->name[0] = '\0';
+	rp->type = _get_bits(ap, 6);
+	rp->repeat = _get_bits(ap, 2);
+	rp->mmsi = _get_bits(ap, 30);
+	switch (rp->type) {
+	case MSG_POSREP_A:
+	case MSG_POSREP_A_ASSIGNED:
+	case MSG_POSREP_A_RESPONSE:
+		rp->nav_status = _get_bits(ap, 4);
+		rp->rot = _get_sbits(ap, 8);
+		rp->sog = _get_bits(ap, 10);
+		rp->accuracy = _get_bits(ap, 1);
+		rp->lon = _get_sbits(ap, 28);
+		rp->lat = _get_sbits(ap, 27);
+		rp->cog = _get_bits(ap, 12);
+		rp->heading = _get_bits(ap, 9);
+		rp->second = _get_bits(ap, 6);
+		rp->flags = AIS_HAS_POSITION|AIS_HAS_MOTION;
+		break;
+
+	case MSG_BASE_STN_REPORT:
+	case MSG_UTC_DATE_RESP:
+		_get_bits(ap, 28);
+		_get_bits(ap, 6);
+		rp->second = _get_bits(ap, 6);
+		rp->accuracy = _get_bits(ap, 1);
+		rp->lon = _get_sbits(ap, 28);
+		rp->lat = _get_sbits(ap, 27);
+		rp->flags = AIS_HAS_POSITION;
+		break;
+
+	case MSG_STATIC_VOYAGE_DATA:
+		_get_bits(ap, 2);
+		_get_bits(ap, 30);
+		_get_bits(ap, 30);
+		_get_bits(ap, 12);
+		_get_text(ap, rp->name, 20);
+		rp->shiptype = _get_bits(ap, 8);
+		rp->flags = AIS_HAS_STATIC;
+		break;
+
+	case MSG_SAR_POSREP:
+		/*
+		 * SAR aircraft report their speed in whole knots.
+		 */
+		_get_bits(ap, 12);
+		if ((rp->sog = _get_bits(ap, 10)) != AIS_SOG_NA)
+			rp->sog *= 10;
+		rp->accuracy = _get_bits(ap, 1);
+		rp->lon = _get_sbits(ap, 28);
+		rp->lat = _get_sbits(ap, 27);
+		rp->cog = _get_bits(ap, 12);
+		rp->second = _get_bits(ap, 6);
+		rp->flags = AIS_HAS_POSITION|AIS_HAS_MOTION;
+		break;
+
+	case MSG_POSREP_B_CS:
+	case MSG_POSREP_B_EQUIP:
+		_get_bits(ap, 8);
+		rp->sog = _get_bits(ap, 10);
+		rp->accuracy = _get_bits(ap, 1);
+		rp->lon = _get_sbits(ap, 28);
+		rp->lat = _get_sbits(ap, 27);
+		rp->cog = _get_bits(ap, 12);
+		rp->heading = _get_bits(ap, 9);
+		rp->second = _get_bits(ap, 6);
+		rp->flags = AIS_HAS_POSITION|AIS_HAS_MOTION;
+		if (rp->type == MSG_POSREP_B_EQUIP) {
+			_get_bits(ap, 4);
+			_get_text(ap, rp->name, 20);
+			rp->shiptype = _get_bits(ap, 8);
+			rp->flags |= AIS_HAS_STATIC;
+		}
+		break;
+
+	case MSG_AID_TO_NAV:
+		_get_bits(ap, 5);
+		_get_text(ap, rp->name, 20);
+		rp->accuracy = _get_bits(ap, 1);
+		rp->lon = _get_sbits(ap, 28);
+		rp->lat = _get_sbits(ap, 27);
+		rp->flags = AIS_HAS_POSITION|AIS_HAS_STATIC;
+		break;
+
+	case MSG_STATIC_DATA:
+		if (_get_bits(ap, 2) == 0)
+			_get_text(ap, rp->name, 20);
+		else
+			rp->shiptype = _get_bits(ap, 8);
+		rp->flags = AIS_HAS_STATIC;
+		break;
+
+	case MSG_POSREP_LONGRANGE:
+		/*
+		 * Long-range reports are in 1/10 minute, and whole knots
+		 * and degrees, so scale them up to match everything else.
+		 */
+		rp->accuracy = _get_bits(ap, 1);
+		_get_bits(ap, 1);
+		rp->nav_status = _get_bits(ap, 4);
+		rp->lon = _get_sbits(ap, 18) * 1000;
+		rp->lat = _get_sbits(ap, 17) * 1000;
+		if ((rp->sog = _get_bits(ap, 6)) == 63)
+			rp->sog = AIS_SOG_NA;
+		else
+			rp->sog *= 10;
+		if ((rp->cog = _get_bits(ap, 9)) == 511)
+			rp->cog = AIS_COG_NA;
+		else
+			rp->cog *= 10;
+		rp->flags = AIS_HAS_POSITION|AIS_HAS_MOTION;
+		break;
+	}
+	if (ap->bit_error)
+		return(-1);
+	if ((rp->flags & AIS_HAS_POSITION) &&
+				(rp->lon > 180 * 600000 || rp->lon < -180 * 600000 ||
+				rp->lat > 90 * 600000 || rp->lat < -90 * 600000))
+		rp->flags &= ~AIS_HAS_POSITION;
+	return(0);
+}
+
+/*
+ * The fixed-offset decoder for type 1, 2, 3 and 18 position reports.
+ * Returns zero, having touched nothing, if the message isn't one of
+ * those or is too short (in which case the bit reader can deal with
+ * it, and report the error).
+ */
+static int
+_decode_posrep(struct ais_msg *ap, struct ais_record *rp)
+{
+	int i, j, type;
+	unsigned long long w[AIS_POSREP_WORDS];
+	unsigned char *xp;
+
+	type = ap->message[0] >> 2;
+	if (ap->msg_len < AIS_POSREP_BYTES || ap->msg_offset != 0 ||
+			(type != MSG_POSREP_A && type != MSG_POSREP_A_ASSIGNED &&
+			type != MSG_POSREP_A_RESPONSE && type != MSG_POSREP_B_CS))
+		return(0);
+	/*
+	 * The message buffer is far longer than the words we load, so
+	 * any bytes past the end of a short payload are harmless. No
+	 * field we use reaches them.
+	 */
+	for (i = 0, xp = ap->message; i < AIS_POSREP_WORDS; i++) {
+		for (w[i] = 0, j = 0; j < 8; j++)
+			w[i] = w[i] << 8 | *xp++;
+	}
+	rp->chan = ap->chan;
+	rp->shiptype = 0;
+	rp->name[0] = '\0';
+	rp->flags = AIS_HAS_POSITION|AIS_HAS_MOTION;
+	AIS_HEADER_FIELDS(_AIS_FIELD)
+	if (type == MSG_POSREP_B_CS) {
+		rp->nav_status = NAV_UNDEFINED;
+		rp->rot = -128;
+		AIS_POSREP_B_FIELDS(_AIS_FIELD)
+	} else {
+		AIS_POSREP_A_FIELDS(_AIS_FIELD)
+	}
+	return(1);
+}
@@ -0,0 +1,226 @@
+/*
+ * Copyright (c) 2021, Kalopa Robotics Limited.  All rights reserved.
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. All advertising materials mentioning features or use of this
+ *    software must display the following acknowledgement:
+ *      "This product includes software developed by Kalopa Robotics
+ *      Limited."
+ *
+ * 4. The name of Kalopa Robotics must not be used to endorse or promote
+ *    products derived from this software without specific prior written
+ *    permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY KALOPA ROBOTICS LIMITED "AS IS" AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL KALOPA ROBOTICS LIMITED
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY,
+ * OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * ABSTRACT
+ * Object pools and arenas. See ais_pool.h.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stddef.h>
+
+#include "ais_pool.h"
+
+/*
+ * Everything handed out is aligned to this.
+ */
+#define ALIGN(n)		(((n) + sizeof(double) - 1) & ~(sizeof(double) - 1))
+
+static struct ais_arena_chunk	*_arena_chunk(struct ais_arena *, unsigned long);
+
+/*
+ * Set up a pool of objects of the given size, allocated nper at a
+ * time. Nothing is allocated until the first object is wanted.
+ */
+void
+ais_pool_init(struct ais_pool *pp, int size, int nper)
+{
+	if (size < sizeof(void *))
+		size = sizeof(void *);
+	pp->size = ALIGN(size);
+	pp->nper = nper > 0 ? nper : AIS_POOL_NPER;
+	pp->free = NULL;
+	pp->chunks = NULL;
+	pp->nchunks = pp->nused = 0;
+}
+
+/*
+ * Take an object from the pool, carving up a new chunk if the free
+ * list is empty. Returns NULL if there's no memory for one. The object
+ * is not cleared.
+ */
+void *
+ais_pool_get(struct ais_pool *pp)
+{
+	int i;
+	char *xp;
+	void *op;
+	struct ais_pool_chunk *cp;
+
+	if (pp->free == NULL) {
+		cp = (struct ais_pool_chunk *)malloc(offsetof(struct ais_pool_chunk, data) +
+													pp->nper * pp->size);
+		if (cp == NULL)
+			return(NULL);
+		cp->next = pp->chunks;
+		pp->chunks = cp;
+		pp->nchunks++;
+		/*
+		 * Thread the new objects onto the free list, in order.
+		 */
+		xp = (char *)cp->data + (pp->nper - 1) * pp->size;
+		for (i = 0; i < pp->nper; i++, xp -= pp->size) {
+			*(void **)xp = pp->free;
+			pp->free = xp;
+		}
+	}
+	op = pp->free;
+	pp->free = *(void **)op;
+	pp->nused++;
+	return(op);
+}
+
+/*
+ * Give an object back.
+ */
+void
+ais_pool_put(struct ais_pool *pp, void *op)
+{
+	*(void **)op = pp->free;
+	pp->free = op;
+	pp->nused--;
+}
+
+/*
+ * Release every chunk, and with them every object, whether or not it
+ * was given back. The pool can be used again afterwards.
+ */
+void
+ais_pool_free(struct ais_pool *pp)
+{
+	struct ais_pool_chunk *cp;
+
+	while ((cp = pp->chunks) != NULL) {
+		pp->chunks = cp->next;
+		free(cp);
+	}
+	pp->free = NULL;
+	pp->nchunks = pp->nused = 0;
+}
+
+/*
+ * Set up an arena which grows in chunks of (at least) the given size.
+ */
+void
+ais_arena_init(struct ais_arena *ap, unsigned long chunk_size)
+{
+	ap->chunk_size = chunk_size > 0 ? chunk_size : AIS_ARENA_CHUNK;
+	ap->ptr = ap->end = NULL;
+	ap->chunks = NULL;
+	ap->total = ap->used = ap->peak = 0;
+}
+
+/*
+ * Allocate from the arena, adding a chunk if there isn't room in the
+ * current one. Returns NULL if there's no memory.
+ */
+void *
+ais_arena_alloc(struct ais_arena *ap, unsigned long size)
+{
+	char *xp;
+	struct ais_arena_chunk *cp;
+
+	size = ALIGN(size > 0 ? size : 1);
+	if (ap->ptr == NULL || size > ap->end - ap->ptr) {
+		if ((cp = _arena_chunk(ap, size > ap->chunk_size ? size : ap->chunk_size)) == NULL)
+			return(NULL);
+		ap->ptr = (char *)cp->data;
+		ap->end = ap->ptr + cp->size;
+	}
+	xp = ap->ptr;
+	ap->ptr += size;
+	if ((ap->used += size) > ap->peak)
+		ap->peak = ap->used;
+	return(xp);
+}
+
+/*
+ * Give back everything allocated since the last reset. If the batch
+ * needed more than one chunk, they're replaced by a single one big
+ * enough for all of it, so that the next batch of the same size costs
+ * no more than a pointer bump per allocation.
+ */
+void
+ais_arena_reset(struct ais_arena *ap)
+{
+	unsigned long size;
+	struct ais_arena_chunk *cp;
+
+	if ((cp = ap->chunks) != NULL && cp->next != NULL) {
+		size = ap->total;
+		ais_arena_free(ap);
+		if ((cp = _arena_chunk(ap, size)) == NULL)
+			return;
+	}
+	if (cp != NULL) {
+		ap->ptr = (char *)cp->data;
+		ap->end = ap->ptr + cp->size;
+	}
+	ap->used = 0;
+}
+
+/*
+ * Release all of the arena's memory. It can be used again afterwards.
+ */
+void
+ais_arena_free(struct ais_arena *ap)
+{
+	struct ais_arena_chunk *cp;
+
+	while ((cp = ap->chunks) != NULL) {
+		ap->chunks = cp->next;
+		free(cp);
+	}
+	ap->ptr = ap->end = NULL;
+	ap->total = ap->used = 0;
+}
+
+/*
+ * Add a chunk to the arena.
+ */
+static struct ais_arena_chunk *
+_arena_chunk(struct ais_arena *ap, unsigned long size)
+{
+	struct ais_arena_chunk *cp;
+
+	size = ALIGN(size);
+	if ((cp = (struct ais_arena_chunk *)malloc(offsetof(struct ais_arena_chunk, data) +
+													size)) == NULL)
+		return(NULL);
+	cp->size = size;
+	cp->next = ap->chunks;
+	ap->chunks = cp;
+	ap->total += size;
+	return(cp);
+}
@@ -0,0 +1,90 @@
+/*
+ * Copyright (c) 2021, Kalopa Robotics Limited.  All rights reserved.
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. All advertising materials mentioning features or use of this
+ *    software must display the following acknowledgement:
+ *      "This product includes software developed by Kalopa Robotics
+ *      Limited."
+ *
+ * 4. The name of Kalopa Robotics must not be used to endorse or promote
+ *    products derived from this software without specific prior written
+ *    permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY KALOPA ROBOTICS LIMITED "AS IS" AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL KALOPA ROBOTICS LIMITED
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY,
+ * OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * ABSTRACT
+ * Two simple allocators for things that come and go a lot. A pool
+ * hands out objects of one size, carved out of chunks, and takes them
+ * back onto a free list. An arena hands out memory of any size by
+ * bumping a pointer, and only gives it back all at once, when it is
+ * reset at the end of a batch of work. Neither ever returns memory to
+ * the system until it is freed, so it stays at its high-water mark
+ * rather than growing over a long run. Neither does any locking, so
+ * each thread keeps its own.
+ */
+#ifndef _AIS_POOL_H_
+#define _AIS_POOL_H_
+
+#define AIS_POOL_NPER		256
+#define AIS_ARENA_CHUNK		65536
+
+struct ais_pool_chunk {
+	struct ais_pool_chunk	*next;
+	double					data[1];
+};
+
+struct ais_pool {
+	int						size;
+	int						nper;
+	void					*free;
+	struct ais_pool_chunk	*chunks;
+	unsigned long			nchunks;
+	unsigned long			nused;
+};
+
+struct ais_arena_chunk {
+	struct ais_arena_chunk	*next;
+	unsigned long			size;
+	double					data[1];
+};
+
+struct ais_arena {
+	unsigned long			chunk_size;
+	char					*ptr;
+	char					*end;
+	struct ais_arena_chunk	*chunks;
+	unsigned long			total;
+	unsigned long			used;
+	unsigned long			peak;
+};
+
+void	ais_pool_init(struct ais_pool *, int, int);
+void	*ais_pool_get(struct ais_pool *);
+void	ais_pool_put(struct ais_pool *, void *);
+void	ais_pool_free(struct ais_pool *);
+void	ais_arena_init(struct ais_arena *, unsigned long);
+void	*ais_arena_alloc(struct ais_arena *, unsigned long);
+void	ais_arena_reset(struct ais_arena *);
+void	ais_arena_free(struct ais_arena *);
+
+#endif /* _AIS_POOL_H_ */
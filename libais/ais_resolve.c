@@ -0,0 +1,261 @@
+/*
+ * Copyright (c) 2021, Kalopa Robotics Limited.  All rights reserved.
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. All advertising materials mentioning features or use of this
+ *    software must display the following acknowledgement:
+ *      "This product includes software developed by Kalopa Robotics
+ *      Limited."
+ *
+ * 4. The name of Kalopa Robotics must not be used to endorse or promote
+ *    products derived from this software without specific prior written
+ *    permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY KALOPA ROBOTICS LIMITED "AS IS" AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL KALOPA ROBOTICS LIMITED
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY,
+ * OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * ABSTRACT
+ * Asynchronous host name resolution, using getaddrinfo() on a helper
+ * thread. The main loop never waits for DNS. It just picks up the
+ * answers as they arrive and decides what to do with them.
+ */
+#include <stdio.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <sys/types.h>
+
+#include "ais_resolve.h"
+
+static void	*_resolver_thread(void *);
+static void	_lookup(struct ais_resolve *, struct ais_resolve *);
+static void	_queue(struct ais_resolver *, struct ais_resolve *);
+
+/*
+ * Start the resolver thread. Names are looked up again every interval
+ * seconds (zero means never).
+ */
+int
+ais_resolver_init(struct ais_resolver *rsp, int interval)
+{
+	memset(rsp, 0, sizeof(*rsp));
+	rsp->interval = interval;
+	if (pipe(rsp->pipefd) < 0)
+		return(-1);
+	fcntl(rsp->pipefd[0], F_SETFL, O_NONBLOCK);
+	fcntl(rsp->pipefd[1], F_SETFL, O_NONBLOCK);
+	pthread_mutex_init(&rsp->lock, NULL);
+	pthread_cond_init(&rsp->cond, NULL);
+	if ((errno = pthread_create(&rsp->thread, NULL, _resolver_thread, rsp)) != 0)
+		return(-1);
+	return(0);
+}
+
+/*
+ * The file descriptor which becomes readable when there are results.
+ */
+int
+ais_resolver_fd(struct ais_resolver *rsp)
+{
+	return(rsp->pipefd[0]);
+}
+
+/*
+ * Register a name, and queue the first lookup for it. With the REPEAT
+ * flag, it'll be looked up again every interval. PASSIVE is for an
+ * address we're going to bind to.
+ */
+void
+ais_resolver_add(struct ais_resolver *rsp, struct ais_resolve *rp,
+					char *host, int port, int socktype, int flags, void *arg)
+{
+	memset(rp, 0, sizeof(*rp));
+	rp->host = host;
+	snprintf(rp->port, sizeof(rp->port), "%d", port);
+	rp->socktype = socktype;
+	rp->flags = flags;
+	rp->arg = arg;
+	rp->status = EAI_AGAIN;
+	pthread_mutex_lock(&rsp->lock);
+	rp->all_next = rsp->all;
+	rsp->all = rp;
+	_queue(rsp, rp);
+	pthread_mutex_unlock(&rsp->lock);
+}
+
+/*
+ * Queue up any lookups which are due. Failed lookups are retried
+ * fairly soon, backing off up to the normal interval.
+ */
+void
+ais_resolver_tick(struct ais_resolver *rsp, time_t now)
+{
+	struct ais_resolve *rp;
+
+	pthread_mutex_lock(&rsp->lock);
+	for (rp = rsp->all; rp != NULL; rp = rp->all_next)
+		if (!rp->busy && rp->due != 0 && rp->due <= now)
+			_queue(rsp, rp);
+	pthread_mutex_unlock(&rsp->lock);
+}
+
+/*
+ * Pick up the next completed lookup, or NULL if there isn't one.
+ */
+struct ais_resolve *
+ais_resolver_next(struct ais_resolver *rsp)
+{
+	char junk[16];
+	struct ais_resolve *rp;
+	time_t now;
+
+	while (read(rsp->pipefd[0], junk, sizeof(junk)) > 0)
+		;
+	pthread_mutex_lock(&rsp->lock);
+	if ((rp = rsp->done) != NULL) {
+		rsp->done = rp->next;
+		rp->busy = 0;
+		time(&now);
+		if (rp->status != 0) {
+			rp->retry = rp->retry == 0 ? AIS_RESOLVE_RETRY : rp->retry * 2;
+			if (rsp->interval > 0 && rp->retry > rsp->interval)
+				rp->retry = rsp->interval;
+			rp->due = now + rp->retry;
+		} else {
+			rp->retry = 0;
+			if ((rp->flags & AIS_RESOLVE_REPEAT) && rsp->interval > 0)
+				rp->due = now + rsp->interval;
+			else
+				rp->due = 0;
+		}
+	}
+	pthread_mutex_unlock(&rsp->lock);
+	return(rp);
+}
+
+/*
+ * Is this address one of the ones the name resolved to?
+ */
+int
+ais_resolve_has(struct ais_resolve *rp, struct sockaddr *sap, socklen_t len)
+{
+	int i;
+
+	for (i = 0; i < rp->naddrs; i++)
+		if (rp->addrlens[i] == len && memcmp(&rp->addrs[i], sap, len) == 0)
+			return(1);
+	return(0);
+}
+
+/*
+ * Printable form of an address, for the logs.
+ */
+char *
+ais_addr_string(struct sockaddr *sap, socklen_t len, char *bufp, int buflen)
+{
+	if (getnameinfo(sap, len, bufp, buflen, NULL, 0, NI_NUMERICHOST) != 0)
+		snprintf(bufp, buflen, "?");
+	return(bufp);
+}
+
+/*
+ * Add an entry to the end of the to-do list. Called with the lock held.
+ */
+static void
+_queue(struct ais_resolver *rsp, struct ais_resolve *rp)
+{
+	struct ais_resolve **rpp;
+
+	rp->busy = 1;
+	rp->due = 0;
+	rp->next = NULL;
+	for (rpp = &rsp->todo; *rpp != NULL; rpp = &(*rpp)->next)
+		;
+	*rpp = rp;
+	pthread_cond_signal(&rsp->cond);
+}
+
+/*
+ * The resolver thread. Take the next name off the list, look it up
+ * (without the lock, because this is the slow bit) and post the
+ * results back.
+ */
+static void *
+_resolver_thread(void *arg)
+{
+	struct ais_resolver *rsp = (struct ais_resolver *)arg;
+	struct ais_resolve *rp, **rpp, result;
+
+	pthread_mutex_lock(&rsp->lock);
+	while (1) {
+		while ((rp = rsp->todo) == NULL)
+			pthread_cond_wait(&rsp->cond, &rsp->lock);
+		rsp->todo = rp->next;
+		pthread_mutex_unlock(&rsp->lock);
+		_lookup(rp, &result);
+		pthread_mutex_lock(&rsp->lock);
+		rp->status = result.status;
+		rp->naddrs = result.naddrs;
+		memcpy(rp->addrs, result.addrs, sizeof(rp->addrs));
+		memcpy(rp->addrlens, result.addrlens, sizeof(rp->addrlens));
+		rp->next = NULL;
+		for (rpp = &rsp->done; *rpp != NULL; rpp = &(*rpp)->next)
+			;
+		*rpp = rp;
+		/*
+		 * If the pipe is full (EAGAIN), there's already a wakeup
+		 * waiting to be read, so it doesn't matter if this one is
+		 * lost.
+		 */
+		while (write(rsp->pipefd[1], "", 1) < 0 && errno == EINTR)
+			;
+	}
+	return(NULL);
+}
+
+/*
+ * Do the actual lookup of an entry, into a result structure.
+ */
+static void
+_lookup(struct ais_resolve *rp, struct ais_resolve *resp)
+{
+	struct addrinfo hints, *res, *aip;
+
+	memset(&hints, 0, sizeof(hints));
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = rp->socktype;
+	hints.ai_flags = AI_ADDRCONFIG;
+	if (rp->flags & AIS_RESOLVE_PASSIVE)
+		hints.ai_flags |= AI_PASSIVE;
+	resp->naddrs = 0;
+	if ((resp->status = getaddrinfo(rp->host, rp->port, &hints, &res)) != 0)
+		return;
+	for (aip = res; aip != NULL && resp->naddrs < AIS_RESOLVE_MAXADDR; aip = aip->ai_next) {
+		if (aip->ai_addrlen > sizeof(struct sockaddr_storage))
+			continue;
+		memcpy(&resp->addrs[resp->naddrs], aip->ai_addr, aip->ai_addrlen);
+		resp->addrlens[resp->naddrs++] = aip->ai_addrlen;
+	}
+	freeaddrinfo(res);
+}
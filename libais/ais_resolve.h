@@ -0,0 +1,104 @@
+/*
+ * Copyright (c) 2021, Kalopa Robotics Limited.  All rights reserved.
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. All advertising materials mentioning features or use of this
+ *    software must display the following acknowledgement:
+ *      "This product includes software developed by Kalopa Robotics
+ *      Limited."
+ *
+ * 4. The name of Kalopa Robotics must not be used to endorse or promote
+ *    products derived from this software without specific prior written
+ *    permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY KALOPA ROBOTICS LIMITED "AS IS" AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL KALOPA ROBOTICS LIMITED
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY,
+ * OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * ABSTRACT
+ * Asynchronous host name resolution. Lookups are done with getaddrinfo()
+ * on a helper thread, and the results are handed back through a pipe
+ * which the caller can select() or epoll() on. Each name is looked up
+ * again every so often, so that a change of address is noticed without
+ * a restart.
+ */
+#ifndef _AIS_RESOLVE_H_
+#define _AIS_RESOLVE_H_
+
+#include <pthread.h>
+#include <time.h>
+#include <sys/socket.h>
+
+#define AIS_RESOLVE_MAXADDR		4
+#define AIS_RESOLVE_INTERVAL	300
+#define AIS_RESOLVE_RETRY		5
+
+/*
+ * Flags for ais_resolver_add().
+ */
+#define AIS_RESOLVE_REPEAT		0x01
+#define AIS_RESOLVE_PASSIVE		0x02
+
+/*
+ * A name to be resolved. The results are valid from when the entry
+ * comes back from ais_resolver_next() until the next call to
+ * ais_resolver_tick(), which might start another lookup.
+ */
+struct ais_resolve {
+	struct ais_resolve		*next;
+	struct ais_resolve		*all_next;
+	char					*host;
+	char					port[8];
+	int						socktype;
+	int						flags;
+	int						busy;
+	time_t					due;
+	int						retry;
+	void					*arg;
+	/*
+	 * Results.
+	 */
+	int						status;
+	int						naddrs;
+	struct sockaddr_storage	addrs[AIS_RESOLVE_MAXADDR];
+	socklen_t				addrlens[AIS_RESOLVE_MAXADDR];
+};
+
+struct ais_resolver {
+	pthread_t				thread;
+	pthread_mutex_t			lock;
+	pthread_cond_t			cond;
+	int						pipefd[2];
+	int						interval;
+	struct ais_resolve		*todo;
+	struct ais_resolve		*done;
+	struct ais_resolve		*all;
+};
+
+int					ais_resolver_init(struct ais_resolver *, int);
+int					ais_resolver_fd(struct ais_resolver *);
+void				ais_resolver_add(struct ais_resolver *, struct ais_resolve *,
+										char *, int, int, int, void *);
+void				ais_resolver_tick(struct ais_resolver *, time_t);
+struct ais_resolve	*ais_resolver_next(struct ais_resolver *);
+int					ais_resolve_has(struct ais_resolve *, struct sockaddr *, socklen_t);
+char				*ais_addr_string(struct sockaddr *, socklen_t, char *, int);
+
+#endif /* _AIS_RESOLVE_H_ */
@@ -0,0 +1,393 @@
+/*
+ * Copyright (c) 2021, Kalopa Robotics Limited.  All rights reserved.
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. All advertising materials mentioning features or use of this
+ *    software must display the following acknowledgement:
+ *      "This product includes software developed by Kalopa Robotics
+ *      Limited."
+ *
+ * 4. The name of Kalopa Robotics must not be used to endorse or promote
+ *    products derived from this software without specific prior written
+ *    permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY KALOPA ROBOTICS LIMITED "AS IS" AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL KALOPA ROBOTICS LIMITED
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY,
+ * OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * ABSTRACT
+ * Shared-memory broadcast ring. The producer writes each entry into the
+ * next slot and bumps the head, using the slot sequence number as a
+ * seqlock. Readers copy an entry out and then check that the sequence
+ * number didn't change underneath them. If it did, they were lapped.
+ * Waking sleeping readers is a single futex call, and only happens if
+ * somebody is actually asleep.
+ */
+#include <stdio.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+
+#include "ais_ring.h"
+
+static struct ais_ring	*_ring_map(char *, int, int);
+static void		*_shm_map(char *, int, int, size_t);
+static char		*_wait_name(char *, char *, int);
+static void		_ring_retire(char *, char *);
+static void		_ring_shut(struct ais_ring_hdr *, struct ais_ring_wait *);
+
+/*
+ * Create (or re-create) a ring with the given name. The number of slots
+ * is rounded up to a power of two.
+ */
+struct ais_ring *
+ais_ring_create(char *name, int nslots)
+{
+	int n;
+	char wname[256];
+	struct ais_ring *rp;
+
+	for (n = 1; n < nslots; n <<= 1)
+		;
+	if (_wait_name(name, wname, sizeof(wname)) == NULL)
+		return(NULL);
+	_ring_retire(name, wname);
+	shm_unlink(name);
+	shm_unlink(wname);
+	if ((rp = _ring_map(name, O_RDWR|O_CREAT, n)) == NULL)
+		return(NULL);
+	if ((rp->wait = _shm_map(wname, O_RDWR|O_CREAT, 0666,
+								sizeof(struct ais_ring_wait))) == NULL) {
+		ais_ring_close(rp);
+		return(NULL);
+	}
+	rp->producer = 1;
+	rp->hdr->version = AIS_RING_VERSION;
+	rp->hdr->nslots = n;
+	rp->hdr->slotsize = AIS_RING_SLOTSIZE;
+	rp->hdr->head = 0;
+	rp->hdr->closed = 0;
+	/*
+	 * Readers won't touch it until the magic number is there.
+	 */
+	__atomic_store_n(&rp->hdr->magic, AIS_RING_MAGIC, __ATOMIC_RELEASE);
+	return(rp);
+}
+
+/*
+ * Attach to an existing ring, as a reader. The ring is mapped
+ * read-only, and only the wait segment writable.
+ */
+struct ais_ring *
+ais_ring_attach(char *name)
+{
+	int fd;
+	char wname[256];
+	struct ais_ring_hdr hdr;
+	struct ais_ring *rp;
+
+	if (_wait_name(name, wname, sizeof(wname)) == NULL ||
+				(fd = shm_open(name, O_RDONLY, 0)) < 0)
+		return(NULL);
+	if (read(fd, &hdr, sizeof(hdr)) != sizeof(hdr) ||
+				hdr.magic != AIS_RING_MAGIC ||
+				hdr.version != AIS_RING_VERSION ||
+				hdr.slotsize != AIS_RING_SLOTSIZE) {
+		close(fd);
+		errno = EINVAL;
+		return(NULL);
+	}
+	close(fd);
+	if (hdr.closed) {
+		errno = EAGAIN;
+		return(NULL);
+	}
+	if ((rp = _ring_map(name, O_RDONLY, hdr.nslots)) == NULL)
+		return(NULL);
+	if ((rp->wait = _shm_map(wname, O_RDWR, 0, sizeof(struct ais_ring_wait))) == NULL) {
+		ais_ring_close(rp);
+		return(NULL);
+	}
+	return(rp);
+}
+
+/*
+ * Map the ring itself, read-write for the producer and read-only for
+ * everyone else.
+ */
+static struct ais_ring *
+_ring_map(char *name, int flags, int nslots)
+{
+	struct ais_ring *rp;
+
+	if ((rp = (struct ais_ring *)malloc(sizeof(*rp))) == NULL)
+		return(NULL);
+	memset(rp, 0, sizeof(*rp));
+	rp->size = sizeof(struct ais_ring_hdr) + nslots * sizeof(struct ais_ring_slot);
+	if ((rp->hdr = _shm_map(name, flags, 0644, rp->size)) == NULL) {
+		free(rp);
+		return(NULL);
+	}
+	rp->slots = (struct ais_ring_slot *)(rp->hdr + 1);
+	return(rp);
+}
+
+/*
+ * Open (or create) a shared-memory segment and map it. A new segment
+ * gets exactly the mode asked for, whatever the umask.
+ */
+static void *
+_shm_map(char *name, int flags, int mode, size_t size)
+{
+	int fd, prot;
+	void *mp;
+
+	if ((fd = shm_open(name, flags, mode)) < 0)
+		return(NULL);
+	prot = (flags & O_ACCMODE) == O_RDONLY ? PROT_READ : PROT_READ|PROT_WRITE;
+	if (((flags & O_CREAT) && (fchmod(fd, mode) < 0 || ftruncate(fd, size) < 0)) ||
+				(mp = mmap(NULL, size, prot, MAP_SHARED, fd, 0)) == MAP_FAILED) {
+		close(fd);
+		return(NULL);
+	}
+	close(fd);
+	return(mp);
+}
+
+/*
+ * The name of the wait segment that goes with a ring.
+ */
+static char *
+_wait_name(char *name, char *buf, int len)
+{
+	if (snprintf(buf, len, "%s.wait", name) >= len) {
+		errno = ENAMETOOLONG;
+		return(NULL);
+	}
+	return(buf);
+}
+
+/*
+ * Mark the ring left behind by an earlier producer as closed, before
+ * it's unlinked. Readers still attached to it would otherwise sit on
+ * the orphaned segment for ever, waiting for entries that never come.
+ */
+static void
+_ring_retire(char *name, char *wname)
+{
+	struct ais_ring_hdr *hp;
+	struct ais_ring_wait *wp;
+
+	if ((hp = _shm_map(name, O_RDWR, 0, sizeof(*hp))) == NULL)
+		return;
+	wp = _shm_map(wname, O_RDWR, 0, sizeof(*wp));
+	if (__atomic_load_n(&hp->magic, __ATOMIC_ACQUIRE) == AIS_RING_MAGIC)
+		_ring_shut(hp, wp);
+	munmap(hp, sizeof(*hp));
+	if (wp != NULL)
+		munmap(wp, sizeof(*wp));
+}
+
+/*
+ * Set the closed flag and wake everyone up, so they notice.
+ */
+static void
+_ring_shut(struct ais_ring_hdr *hp, struct ais_ring_wait *wp)
+{
+	__atomic_store_n(&hp->closed, 1, __ATOMIC_SEQ_CST);
+	if (wp != NULL) {
+		__atomic_add_fetch(&wp->wakeup, 1, __ATOMIC_SEQ_CST);
+		syscall(SYS_futex, &wp->wakeup, FUTEX_WAKE, 0x7fffffff, NULL, NULL, 0);
+	}
+}
+
+/*
+ * Detach from the ring. When the producer does it, the ring is marked
+ * closed so that readers go looking for a new one.
+ */
+void
+ais_ring_close(struct ais_ring *rp)
+{
+	if (rp->producer)
+		_ring_shut(rp->hdr, rp->wait);
+	munmap(rp->hdr, rp->size);
+	if (rp->wait != NULL)
+		munmap(rp->wait, sizeof(struct ais_ring_wait));
+	free(rp);
+}
+
+/*
+ * Publish an entry. This never blocks, no matter what the readers are
+ * up to. Entries too big for a slot are dropped (and counted).
+ */
+void
+ais_ring_put(struct ais_ring *rp, int kind, const void *datap, int len, long long stamp)
+{
+	unsigned long long seq;
+	struct ais_ring_slot *sp;
+
+	if (len > AIS_RING_DATASIZE) {
+		rp->ndropped++;
+		return;
+	}
+	seq = rp->hdr->head + 1;
+	sp = &rp->slots[seq & (rp->hdr->nslots - 1)];
+	__atomic_store_n(&sp->seq, 0, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+	sp->kind = kind;
+	sp->len = len;
+	sp->stamp = stamp;
+	memcpy(sp->data, datap, len);
+	__atomic_store_n(&sp->seq, seq, __ATOMIC_RELEASE);
+	__atomic_store_n(&rp->hdr->head, seq, __ATOMIC_RELEASE);
+	/*
+	 * The head store has to be seen before we look for waiters, just
+	 * as a reader's waiter count has to be seen before it looks at the
+	 * head. Otherwise each can miss the other, and the reader sleeps
+	 * until its timeout with data waiting.
+	 */
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+	if (__atomic_load_n(&rp->wait->waiters, __ATOMIC_SEQ_CST) > 0) {
+		__atomic_add_fetch(&rp->wait->wakeup, 1, __ATOMIC_SEQ_CST);
+		syscall(SYS_futex, &rp->wait->wakeup, FUTEX_WAKE, 0x7fffffff, NULL, NULL, 0);
+	}
+}
+
+/*
+ * Set up a reader. It starts either with the oldest entry still in the
+ * ring, or with the next one to be written.
+ */
+void
+ais_ring_reader(struct ais_ring *rp, struct ais_ring_reader *rdp, int from_oldest)
+{
+	unsigned long long head;
+
+	rdp->ring = rp;
+	rdp->nlost = 0;
+	head = __atomic_load_n(&rp->hdr->head, __ATOMIC_ACQUIRE);
+	if (from_oldest && head >= rp->hdr->nslots)
+		rdp->next = head - rp->hdr->nslots + 1;
+	else if (from_oldest)
+		rdp->next = 1;
+	else
+		rdp->next = head + 1;
+}
+
+/*
+ * Copy out the next entry. Returns its length, or zero if there's
+ * nothing new, or -1 if it won't fit in the buffer (it's skipped), or
+ * AIS_RING_CLOSED if the ring has been closed and there's nothing
+ * left in it. If the producer has lapped us, the lost entries are
+ * counted and we carry on from the oldest one still there. Every pass
+ * round the loop either returns or moves on an entry, so it can't spin.
+ */
+int
+ais_ring_get(struct ais_ring_reader *rdp, int *kindp, void *bufp, int maxlen, long long *stampp)
+{
+	int len, kind;
+	long long stamp;
+	unsigned long long head, seq, nslots;
+	struct ais_ring_slot *sp;
+	struct ais_ring_hdr *hp = rdp->ring->hdr;
+
+	nslots = hp->nslots;
+	while (1) {
+		head = __atomic_load_n(&hp->head, __ATOMIC_ACQUIRE);
+		if (rdp->next > head) {
+			/*
+			 * Nothing is written after the ring is closed, so
+			 * once the flag is seen, so is the final head.
+			 */
+			if (!__atomic_load_n(&hp->closed, __ATOMIC_ACQUIRE))
+				return(0);
+			if (rdp->next > __atomic_load_n(&hp->head, __ATOMIC_ACQUIRE))
+				return(AIS_RING_CLOSED);
+			continue;
+		}
+		if (head - rdp->next >= nslots) {
+			rdp->nlost += head - nslots + 1 - rdp->next;
+			rdp->next = head - nslots + 1;
+		}
+		/*
+		 * The head says our entry was published, so if the slot
+		 * doesn't hold it now, the producer has started writing
+		 * over it. Don't wait to see the head move (the producer
+		 * may have died in the middle), just count it as lost.
+		 */
+		sp = &rdp->ring->slots[rdp->next & (nslots - 1)];
+		if ((seq = __atomic_load_n(&sp->seq, __ATOMIC_ACQUIRE)) != rdp->next) {
+			rdp->nlost++;
+			rdp->next++;
+			continue;
+		}
+		kind = sp->kind;
+		len = sp->len;
+		stamp = sp->stamp;
+		if (len <= maxlen)
+			memcpy(bufp, sp->data, len);
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+		rdp->next++;
+		if (__atomic_load_n(&sp->seq, __ATOMIC_RELAXED) != seq) {
+			rdp->nlost++;
+			continue;
+		}
+		if (len > maxlen)
+			return(-1);
+		if (kindp != NULL)
+			*kindp = kind;
+		if (stampp != NULL)
+			*stampp = stamp;
+		return(len);
+	}
+}
+
+/*
+ * Sleep until there's something new to read, or the timeout (in
+ * milliseconds) expires. Returns 1 if there's data waiting, or if
+ * the ring has been closed (which ais_ring_get() will then report).
+ */
+int
+ais_ring_wait(struct ais_ring_reader *rdp, int msecs)
+{
+	unsigned int wakeup;
+	struct timespec ts;
+	struct ais_ring_hdr *hp = rdp->ring->hdr;
+	struct ais_ring_wait *wp = rdp->ring->wait;
+
+	__atomic_add_fetch(&wp->waiters, 1, __ATOMIC_SEQ_CST);
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+	wakeup = __atomic_load_n(&wp->wakeup, __ATOMIC_SEQ_CST);
+	if (rdp->next > __atomic_load_n(&hp->head, __ATOMIC_SEQ_CST) &&
+				!__atomic_load_n(&hp->closed, __ATOMIC_SEQ_CST)) {
+		ts.tv_sec = msecs / 1000;
+		ts.tv_nsec = (msecs % 1000) * 1000000L;
+		syscall(SYS_futex, &wp->wakeup, FUTEX_WAIT, wakeup, &ts, NULL, 0);
+	}
+	__atomic_sub_fetch(&wp->waiters, 1, __ATOMIC_SEQ_CST);
+	return(rdp->next <= __atomic_load_n(&hp->head, __ATOMIC_ACQUIRE) ||
+				__atomic_load_n(&hp->closed, __ATOMIC_ACQUIRE));
+}
@@ -0,0 +1,127 @@
+/*
+ * Copyright (c) 2021, Kalopa Robotics Limited.  All rights reserved.
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. All advertising materials mentioning features or use of this
+ *    software must display the following acknowledgement:
+ *      "This product includes software developed by Kalopa Robotics
+ *      Limited."
+ *
+ * 4. The name of Kalopa Robotics must not be used to endorse or promote
+ *    products derived from this software without specific prior written
+ *    permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY KALOPA ROBOTICS LIMITED "AS IS" AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL KALOPA ROBOTICS LIMITED
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY,
+ * OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * ABSTRACT
+ * A single-producer, multi-reader broadcast ring in POSIX shared memory.
+ * The producer never waits for anyone. Each reader keeps its own
+ * cursor, and works out from the sequence numbers whether it has been
+ * lapped by the producer.
+ */
+#ifndef _AIS_RING_H_
+#define _AIS_RING_H_
+
+#define AIS_RING_MAGIC		0x41495352
+#define AIS_RING_VERSION	3
+#define AIS_RING_NSLOTS		4096
+#define AIS_RING_SLOTSIZE	256
+#define AIS_RING_DATASIZE	(AIS_RING_SLOTSIZE - 24)
+
+/*
+ * What's in a slot.
+ */
+#define AIS_RING_SENTENCE	1
+#define AIS_RING_RECORD		2
+
+/*
+ * What ais_ring_get() returns once the producer has gone away (or been
+ * restarted) and everything it wrote has been read. The reader should
+ * close the ring and attach again.
+ */
+#define AIS_RING_CLOSED		-2
+
+/*
+ * The shared header lives on its own cache line, so readers polling the
+ * head don't fight over the slots. A slot sequence number of zero
+ * means it's being written. The closed flag is set when the producer
+ * closes the ring, or when a new producer replaces it, so that readers
+ * left holding the old segment know to attach again.
+ */
+struct ais_ring_hdr {
+	unsigned int		magic;
+	unsigned int		version;
+	unsigned int		nslots;
+	unsigned int		slotsize;
+	unsigned long long	head;
+	unsigned int		closed;
+	unsigned int		spare;
+	char				pad[64 - 32];
+};
+
+/*
+ * The only things readers ever write are the futex word and the count
+ * of sleepers, so those live in a segment of their own ("<name>.wait").
+ * The ring itself is created mode 0644 and readers map it read-only.
+ * The wait segment is mode 0666, so that a reader running as any user
+ * can attach. The most a stray writer can do to it is cause spurious
+ * wakeups, or make readers sleep until their timeout.
+ */
+struct ais_ring_wait {
+	unsigned int		wakeup;
+	unsigned int		waiters;
+	char				pad[64 - 8];
+};
+
+struct ais_ring_slot {
+	unsigned long long	seq;
+	unsigned short		kind;
+	unsigned short		len;
+	unsigned int		spare;
+	long long			stamp;
+	char				data[AIS_RING_DATASIZE];
+};
+
+struct ais_ring {
+	struct ais_ring_hdr	*hdr;
+	struct ais_ring_slot *slots;
+	struct ais_ring_wait *wait;
+	size_t				size;
+	int					producer;
+	unsigned long		ndropped;
+};
+
+struct ais_ring_reader {
+	struct ais_ring		*ring;
+	unsigned long long	next;
+	unsigned long		nlost;
+};
+
+struct ais_ring	*ais_ring_create(char *, int);
+struct ais_ring	*ais_ring_attach(char *);
+void			ais_ring_close(struct ais_ring *);
+void			ais_ring_put(struct ais_ring *, int, const void *, int, long long);
+void			ais_ring_reader(struct ais_ring *, struct ais_ring_reader *, int);
+int				ais_ring_get(struct ais_ring_reader *, int *, void *, int, long long *);
+int				ais_ring_wait(struct ais_ring_reader *, int);
+
+#endif /* _AIS_RING_H_ */
@@ -0,0 +1,139 @@
+/*
+ * Copyright (c) 2021, Kalopa Robotics Limited.  All rights reserved.
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. All advertising materials mentioning features or use of this
+ *    software must display the following acknowledgement:
+ *      "This product includes software developed by Kalopa Robotics
+ *      Limited."
+ *
+ * 4. The name of Kalopa Robotics must not be used to endorse or promote
+ *    products derived from this software without specific prior written
+ *    permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY KALOPA ROBOTICS LIMITED "AS IS" AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL KALOPA ROBOTICS LIMITED
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY,
+ * OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * ABSTRACT
+ * Per-source sequence tracking. See ais_seq.h.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ais.h"
+#include "ais_seq.h"
+
+/*
+ * Account for a tagged sentence which has just arrived (at now_ms).
+ * Sentences without a source and a sequence number are ignored. We
+ * keep a bitmap of the last few sequence numbers below the highest
+ * one, which is enough to tell a late arrival from a duplicate. A gap
+ * is counted as lost until (if ever) it's filled. A source numbers
+ * and stamps its sentences in the same order, so one which comes in
+ * numbered below the highest but stamped after it means the source
+ * has started again, however few sentences it had sent. Without
+ * timestamps, only a very large jump counts as a restart. Returns the
+ * source, or NULL.
+ */
+struct ais_seqsrc *
+ais_seq_update(struct ais_seqtab *stp, struct nmea_tag *tp, long long now_ms)
+{
+	int i;
+	long long latency, stamp;
+	unsigned long gap;
+	struct ais_seqsrc *sp;
+
+	if ((tp->flags & (NMEA_TAG_SRC|NMEA_TAG_SEQ)) != (NMEA_TAG_SRC|NMEA_TAG_SEQ))
+		return(NULL);
+	stamp = (tp->flags & NMEA_TAG_TIME) ? tp->time_ms : 0;
+	for (i = 0, sp = stp->src; i < stp->nsrc; i++, sp++)
+		if (strcmp(sp->name, tp->src) == 0)
+			break;
+	if (i == stp->nsrc) {
+		if (stp->nsrc == AIS_SEQ_MAXSRC)
+			return(NULL);
+		stp->nsrc++;
+		memset(sp, 0, sizeof(*sp));
+		strcpy(sp->name, tp->src);
+		sp->highest = tp->seq;
+		sp->highest_ms = stamp;
+		sp->seen = 1;
+	} else if (tp->seq > sp->highest) {
+		if ((gap = tp->seq - sp->highest) > AIS_SEQ_RESTART) {
+			sp->nrestart++;
+			sp->seen = 1;
+		} else {
+			sp->nlost += gap - 1;
+			sp->seen = gap < AIS_SEQ_WINDOW ? (sp->seen << gap) | 1 : 1;
+		}
+		sp->highest = tp->seq;
+		sp->highest_ms = stamp;
+	} else if (stamp > 0 && sp->highest_ms > 0 ? stamp > sp->highest_ms :
+										sp->highest - tp->seq > AIS_SEQ_RESTART) {
+		sp->nrestart++;
+		sp->highest = tp->seq;
+		sp->highest_ms = stamp;
+		sp->seen = 1;
+	} else if ((gap = sp->highest - tp->seq) >= AIS_SEQ_WINDOW) {
+		sp->nreorder++;
+	} else if (sp->seen & (1ULL << gap)) {
+		sp->ndup++;
+		return(sp);
+	} else {
+		sp->seen |= 1ULL << gap;
+		sp->nreorder++;
+		if (sp->nlost > 0)
+			sp->nlost--;
+	}
+	sp->nrecv++;
+	if (tp->flags & NMEA_TAG_TIME) {
+		latency = now_ms - tp->time_ms;
+		if (sp->nlatency == 0 || latency < sp->latency_min)
+			sp->latency_min = latency;
+		if (sp->nlatency == 0 || latency > sp->latency_max)
+			sp->latency_max = latency;
+		sp->latency_sum += latency;
+		sp->nlatency++;
+	}
+	return(sp);
+}
+
+/*
+ * One line per source. Latency is one-way, so it's only as good as
+ * the clocks at either end.
+ */
+void
+ais_seq_print(struct ais_seqtab *stp, FILE *fp)
+{
+	int i;
+	struct ais_seqsrc *sp;
+
+	for (i = 0, sp = stp->src; i < stp->nsrc; i++, sp++) {
+		fprintf(fp, "SEQ: %s - %lu received, %lu lost, %lu dup, %lu reordered, %lu restarts",
+					sp->name, sp->nrecv, sp->nlost, sp->ndup, sp->nreorder, sp->nrestart);
+		if (sp->nlatency > 0)
+			fprintf(fp, ", latency %lld/%lld/%lld ms (min/avg/max)",
+						sp->latency_min, sp->latency_sum / (long long )sp->nlatency,
+						sp->latency_max);
+		fputc('\n', fp);
+	}
+}
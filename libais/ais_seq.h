@@ -0,0 +1,73 @@
+/*
+ * Copyright (c) 2021, Kalopa Robotics Limited.  All rights reserved.
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. All advertising materials mentioning features or use of this
+ *    software must display the following acknowledgement:
+ *      "This product includes software developed by Kalopa Robotics
+ *      Limited."
+ *
+ * 4. The name of Kalopa Robotics must not be used to endorse or promote
+ *    products derived from this software without specific prior written
+ *    permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY KALOPA ROBOTICS LIMITED "AS IS" AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL KALOPA ROBOTICS LIMITED
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY,
+ * OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * ABSTRACT
+ * Per-source sequence tracking for TAG-blocked sentences. Every hop
+ * which frames its output stamps each sentence with its own name, a
+ * sequence number and the time it was received, so the next hop along
+ * can count what went missing, what turned up twice or out of order,
+ * and how long it all took to get there.
+ */
+#ifndef _AIS_SEQ_H_
+#define _AIS_SEQ_H_
+
+#define AIS_SEQ_MAXSRC		16
+#define AIS_SEQ_WINDOW		64
+#define AIS_SEQ_RESTART		10000
+
+struct ais_seqsrc {
+	char				name[NMEA_TAG_SRCLEN];
+	unsigned long		highest;
+	long long			highest_ms;
+	unsigned long long	seen;
+	unsigned long		nrecv;
+	unsigned long		nlost;
+	unsigned long		ndup;
+	unsigned long		nreorder;
+	unsigned long		nrestart;
+	unsigned long		nlatency;
+	long long			latency_sum;
+	long long			latency_min;
+	long long			latency_max;
+};
+
+struct ais_seqtab {
+	int					nsrc;
+	struct ais_seqsrc	src[AIS_SEQ_MAXSRC];
+};
+
+struct ais_seqsrc	*ais_seq_update(struct ais_seqtab *, struct nmea_tag *, long long);
+void				ais_seq_print(struct ais_seqtab *, FILE *);
+
+#endif /* _AIS_SEQ_H_ */
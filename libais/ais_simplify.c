@@ -0,0 +1,283 @@
+/*
+ * Copyright (c) 2021, Kalopa Robotics Limited.  All rights reserved.
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. All advertising materials mentioning features or use of this
+ *    software must display the following acknowledgement:
+ *      "This product includes software developed by Kalopa Robotics
+ *      Limited."
+ *
+ * 4. The name of Kalopa Robotics must not be used to endorse or promote
+ *    products derived from this software without specific prior written
+ *    permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY KALOPA ROBOTICS LIMITED "AS IS" AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL KALOPA ROBOTICS LIMITED
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY,
+ * OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * ABSTRACT
+ * Per-vessel trajectory simplification. See ais_simplify.h.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "ais.h"
+#include "ais_pool.h"
+#include "ais_simplify.h"
+
+/*
+ * Metres in one unit (1/10000 minute) of latitude.
+ */
+#define UNIT_METRES		0.1852
+
+static struct ais_svessel	*_vessel(struct ais_simplify *, unsigned int, int);
+static void		_emit(struct ais_simplify *, struct ais_svessel *, struct ais_spoint *);
+static double	_sed(struct ais_spoint *, struct ais_spoint *, struct ais_spoint *);
+static double	_dr_error(struct ais_spoint *, struct ais_spoint *);
+
+/*
+ * Set up a simplifier. The tolerance is in metres, and a point is
+ * always kept if it's more than maxgap seconds since the last one.
+ * In DR mode the emit function can be NULL, and the return value of
+ * ais_simp_add() used instead.
+ */
+void
+ais_simp_init(struct ais_simplify *sp, int mode, double tolerance, int maxgap,
+				void (*emit)(void *, unsigned int, struct ais_spoint *), void *arg)
+{
+	memset(sp, 0, sizeof(*sp));
+	sp->mode = mode;
+	sp->tolerance = tolerance;
+	sp->maxgap = maxgap > 0 ? maxgap : AIS_SIMP_MAXGAP;
+	sp->emit = emit;
+	sp->arg = arg;
+	ais_pool_init(&sp->vpool, sizeof(struct ais_svessel), 0);
+}
+
+/*
+ * Is this a message type we simplify?
+ */
+int
+ais_simp_wanted(int type)
+{
+	switch (type) {
+	case MSG_POSREP_A:
+	case MSG_POSREP_A_ASSIGNED:
+	case MSG_POSREP_A_RESPONSE:
+	case MSG_POSREP_B_CS:
+	case MSG_POSREP_B_EQUIP:
+	case MSG_POSREP_LONGRANGE:
+		return(1);
+	}
+	return(0);
+}
+
+/*
+ * Add a point. Returns 1 if the point was emitted straight away, which
+ * in DR mode means "keep it".
+ */
+int
+ais_simp_add(struct ais_simplify *sp, unsigned int mmsi, struct ais_spoint *pp)
+{
+	int i;
+	struct ais_svessel *vp;
+
+	sp->npoints_in++;
+	if ((vp = _vessel(sp, mmsi, pp->time)) == NULL) {
+		/*
+		 * No room to track it, so just let it through.
+		 */
+		sp->npoints_out++;
+		if (sp->emit != NULL)
+			sp->emit(sp->arg, mmsi, pp);
+		return(1);
+	}
+	vp->last_seen = pp->time;
+	if (vp->anchor.time < 0 || pp->time - vp->anchor.time > sp->maxgap) {
+		if (vp->npoints > 0 && pp->time - vp->points[vp->npoints - 1].time <= sp->maxgap)
+			_emit(sp, vp, &vp->points[vp->npoints - 1]);
+		_emit(sp, vp, pp);
+		return(1);
+	}
+	if (sp->mode == AIS_SIMP_DR) {
+		if (_dr_error(&vp->anchor, pp) <= sp->tolerance)
+			return(0);
+		_emit(sp, vp, pp);
+		return(1);
+	}
+	/*
+	 * Opening window. If every point in the window is close enough
+	 * to the line from the anchor to the new point, the window can
+	 * open a little wider. Otherwise the last point in the window
+	 * becomes the new anchor.
+	 */
+	for (i = 0; i < vp->npoints; i++)
+		if (_sed(&vp->anchor, pp, &vp->points[i]) > sp->tolerance)
+			break;
+	if (i < vp->npoints || vp->npoints == AIS_SIMP_NPOINTS) {
+		_emit(sp, vp, &vp->points[vp->npoints - 1]);
+		if (pp->time - vp->anchor.time > sp->maxgap) {
+			_emit(sp, vp, pp);
+			return(1);
+		}
+	}
+	vp->points[vp->npoints++] = *pp;
+	return(0);
+}
+
+/*
+ * Forget about any vessels we haven't heard from since maxgap seconds
+ * before now, emitting the end of their tracks.
+ */
+void
+ais_simp_expire(struct ais_simplify *sp, int now)
+{
+	int i;
+	struct ais_svessel *vp, **vpp;
+
+	for (i = 0; i < AIS_SIMP_NBUCKETS; i++) {
+		for (vpp = &sp->buckets[i]; (vp = *vpp) != NULL;) {
+			if (now - vp->last_seen <= sp->maxgap) {
+				vpp = &vp->next;
+				continue;
+			}
+			if (vp->npoints > 0)
+				_emit(sp, vp, &vp->points[vp->npoints - 1]);
+			*vpp = vp->next;
+			ais_pool_put(&sp->vpool, vp);
+			sp->nvessels--;
+		}
+	}
+}
+
+/*
+ * Emit the end of every track and forget about all of them, giving
+ * back their memory.
+ */
+void
+ais_simp_flush(struct ais_simplify *sp)
+{
+	int i;
+	struct ais_svessel *vp;
+
+	for (i = 0; i < AIS_SIMP_NBUCKETS; i++) {
+		while ((vp = sp->buckets[i]) != NULL) {
+			if (vp->npoints > 0)
+				_emit(sp, vp, &vp->points[vp->npoints - 1]);
+			sp->buckets[i] = vp->next;
+		}
+	}
+	ais_pool_free(&sp->vpool);
+	sp->nvessels = 0;
+}
+
+/*
+ * Find (or create) the state for a vessel.
+ */
+static struct ais_svessel *
+_vessel(struct ais_simplify *sp, unsigned int mmsi, int now)
+{
+	struct ais_svessel *vp, **vpp;
+
+	vpp = &sp->buckets[mmsi % AIS_SIMP_NBUCKETS];
+	for (vp = *vpp; vp != NULL; vp = vp->next)
+		if (vp->mmsi == mmsi)
+			return(vp);
+	if (sp->nvessels >= AIS_SIMP_MAXVESSELS) {
+		ais_simp_expire(sp, now);
+		if (sp->nvessels >= AIS_SIMP_MAXVESSELS)
+			return(NULL);
+	}
+	if ((vp = (struct ais_svessel *)ais_pool_get(&sp->vpool)) == NULL)
+		return(NULL);
+	vp->mmsi = mmsi;
+	vp->npoints = 0;
+	vp->anchor.time = -1;
+	vp->next = *vpp;
+	*vpp = vp;
+	sp->nvessels++;
+	return(vp);
+}
+
+/*
+ * Emit a point, which becomes the new anchor. Anything in the window
+ * up to and including it is done with.
+ */
+static void
+_emit(struct ais_simplify *sp, struct ais_svessel *vp, struct ais_spoint *pp)
+{
+	int i;
+
+	vp->anchor = *pp;
+	for (i = 0; i < vp->npoints; i++)
+		if (&vp->points[i] == pp)
+			break;
+	if (i < vp->npoints) {
+		vp->npoints -= i + 1;
+		memmove(vp->points, &vp->points[i + 1], vp->npoints * sizeof(*pp));
+	} else
+		vp->npoints = 0;
+	sp->npoints_out++;
+	if (sp->emit != NULL)
+		sp->emit(sp->arg, vp->mmsi, &vp->anchor);
+}
+
+/*
+ * Synchronised Euclidean distance, in metres. How far is point p from
+ * where it would be at that time, moving in a straight line from a
+ * to b?
+ */
+static double
+_sed(struct ais_spoint *ap, struct ais_spoint *bp, struct ais_spoint *pp)
+{
+	double frac, lat, lon, dx, dy;
+
+	frac = bp->time > ap->time ? (double )(pp->time - ap->time) / (bp->time - ap->time) : 0.0;
+	lat = ap->lat + (bp->lat - ap->lat) * frac;
+	lon = ap->lon + (bp->lon - ap->lon) * frac;
+	dy = (pp->lat - lat) * UNIT_METRES;
+	dx = (pp->lon - lon) * UNIT_METRES * cos(pp->lat * M_PI / (180.0 * 600000.0));
+	return(sqrt(dx * dx + dy * dy));
+}
+
+/*
+ * How far is point p from where dead reckoning from a says it should
+ * be, in metres?
+ */
+static double
+_dr_error(struct ais_spoint *ap, struct ais_spoint *pp)
+{
+	double dist, cog, lat, lon, dx, dy, coslat;
+
+	coslat = cos(ap->lat * M_PI / (180.0 * 600000.0));
+	lat = ap->lat;
+	lon = ap->lon;
+	if (ap->sog != AIS_SOG_NA && ap->cog != AIS_COG_NA && coslat > 0.01) {
+		dist = ap->sog / 10.0 * 1852.0 / 3600.0 * (pp->time - ap->time);
+		cog = ap->cog / 10.0 * M_PI / 180.0;
+		lat += dist * cos(cog) / UNIT_METRES;
+		lon += dist * sin(cog) / (UNIT_METRES * coslat);
+	}
+	dy = (pp->lat - lat) * UNIT_METRES;
+	dx = (pp->lon - lon) * UNIT_METRES * coslat;
+	return(sqrt(dx * dx + dy * dy));
+}
@@ -0,0 +1,104 @@
+/*
+ * Copyright (c) 2021, Kalopa Robotics Limited.  All rights reserved.
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. All advertising materials mentioning features or use of this
+ *    software must display the following acknowledgement:
+ *      "This product includes software developed by Kalopa Robotics
+ *      Limited."
+ *
+ * 4. The name of Kalopa Robotics must not be used to endorse or promote
+ *    products derived from this software without specific prior written
+ *    permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY KALOPA ROBOTICS LIMITED "AS IS" AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL KALOPA ROBOTICS LIMITED
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY,
+ * OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * ABSTRACT
+ * Streaming per-vessel trajectory simplification. Position reports go
+ * in, and only the points needed to rebuild each track to within a
+ * given tolerance come out.
+ *
+ * There are two modes. AIS_SIMP_WINDOW keeps a small window of points
+ * per vessel, and emits a point only when the track can no longer be
+ * drawn as a straight line from the last emitted point to within the
+ * tolerance (an opening-window Douglas-Peucker, using the time-synced
+ * distance). Points come out a little late, which is fine for storage.
+ * AIS_SIMP_DR decides straight away, keeping a point if it's further
+ * from where dead reckoning from the last kept point says it should be
+ * than the tolerance. That suits a live feed.
+ */
+#ifndef _AIS_SIMPLIFY_H_
+#define _AIS_SIMPLIFY_H_
+
+#define AIS_SIMP_WINDOW		0
+#define AIS_SIMP_DR			1
+
+#define AIS_SIMP_NPOINTS	16
+#define AIS_SIMP_MAXGAP		300
+#define AIS_SIMP_NBUCKETS	4096
+#define AIS_SIMP_MAXVESSELS	65536
+
+/*
+ * A point on a track. Positions are in 1/10000 minute, as per the
+ * struct ais_record.
+ */
+struct ais_spoint {
+	int				time;
+	int				lat;
+	int				lon;
+	short			sog;
+	short			cog;
+	short			heading;
+	unsigned char	type;
+	unsigned char	nav_status;
+};
+
+struct ais_svessel {
+	struct ais_svessel	*next;
+	unsigned int		mmsi;
+	int					last_seen;
+	int					npoints;
+	struct ais_spoint	anchor;
+	struct ais_spoint	points[AIS_SIMP_NPOINTS];
+};
+
+struct ais_simplify {
+	int					mode;
+	double				tolerance;
+	int					maxgap;
+	int					nvessels;
+	struct ais_svessel	*buckets[AIS_SIMP_NBUCKETS];
+	struct ais_pool		vpool;
+	void				(*emit)(void *, unsigned int, struct ais_spoint *);
+	void				*arg;
+	unsigned long		npoints_in;
+	unsigned long		npoints_out;
+};
+
+void	ais_simp_init(struct ais_simplify *, int, double, int,
+						void (*)(void *, unsigned int, struct ais_spoint *), void *);
+int		ais_simp_add(struct ais_simplify *, unsigned int, struct ais_spoint *);
+void	ais_simp_expire(struct ais_simplify *, int);
+void	ais_simp_flush(struct ais_simplify *);
+int		ais_simp_wanted(int);
+
+#endif /* _AIS_SIMPLIFY_H_ */
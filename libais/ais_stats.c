@@ -0,0 +1,292 @@
+/*
+ * Copyright (c) 2021, Kalopa Robotics Limited.  All rights reserved.
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. All advertising materials mentioning features or use of this
+ *    software must display the following acknowledgement:
+ *      "This product includes software developed by Kalopa Robotics
+ *      Limited."
+ *
+ * 4. The name of Kalopa Robotics must not be used to endorse or promote
+ *    products derived from this software without specific prior written
+ *    permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY KALOPA ROBOTICS LIMITED "AS IS" AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL KALOPA ROBOTICS LIMITED
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY,
+ * OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * ABSTRACT
+ * Streaming statistics for a receiver. See ais_stats.h.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <math.h>
+#include <sys/stat.h>
+
+#include "ais.h"
+#include "ais_stats.h"
+
+static unsigned long long	_hash(unsigned int);
+static void	_heavy(struct ais_stats *, unsigned int);
+
+/*
+ * Set up the statistics for a receiver, with the window starting at
+ * the top of the current hour.
+ */
+void
+ais_stats_init(struct ais_stats *sp, char *name, long now)
+{
+	memset(sp, 0, sizeof(*sp));
+	strncpy(sp->name, name, AIS_STATS_NAMELEN - 1);
+	ais_stats_reset(sp, now);
+}
+
+/*
+ * Tell us where the receiver is, so we can work out ranges.
+ */
+void
+ais_stats_position(struct ais_stats *sp, int lat, int lon)
+{
+	sp->has_position = 1;
+	sp->lat = lat;
+	sp->lon = lon;
+}
+
+/*
+ * Start a new window. Everything but the name and position goes.
+ */
+void
+ais_stats_reset(struct ais_stats *sp, long now)
+{
+	sp->window = now - now % AIS_STATS_WINDOW;
+	sp->nsentences = sp->nmessages = 0;
+	memset(sp->types, 0, sizeof(sp->types));
+	memset(sp->chans, 0, sizeof(sp->chans));
+	memset(sp->ranges, 0, sizeof(sp->ranges));
+	sp->max_range = 0.0;
+	sp->ntop = 0;
+	memset(sp->hll, 0, sizeof(sp->hll));
+	memset(sp->cms, 0, sizeof(sp->cms));
+}
+
+/*
+ * Count a validated sentence.
+ */
+void
+ais_stats_sentence(struct ais_stats *sp)
+{
+	sp->nsentences++;
+}
+
+/*
+ * Count a decoded message.
+ */
+void
+ais_stats_record(struct ais_stats *sp, struct ais_record *rp)
+{
+	int i, rho;
+	unsigned long long h;
+	double dlat, dlon, range;
+
+	sp->nmessages++;
+	sp->types[rp->type < AIS_STATS_NTYPES ? rp->type : 0]++;
+	sp->chans[rp->chan ? 1 : 0]++;
+	/*
+	 * The top bits of the hash pick a register, and the register
+	 * keeps the longest run of leading zeroes seen in the rest.
+	 */
+	h = _hash(rp->mmsi);
+	i = h >> (64 - AIS_HLL_BITS);
+	h <<= AIS_HLL_BITS;
+	for (rho = 1; rho <= 64 - AIS_HLL_BITS && (h & (1ULL << 63)) == 0; rho++)
+		h <<= 1;
+	if (rho > sp->hll[i])
+		sp->hll[i] = rho;
+	_heavy(sp, rp->mmsi);
+	if (sp->has_position && (rp->flags & AIS_HAS_POSITION)) {
+		dlat = (rp->lat - sp->lat) / 10000.0;
+		dlon = (rp->lon - sp->lon) / 10000.0 * cos(sp->lat * M_PI / (180.0 * 600000.0));
+		range = sqrt(dlat * dlat + dlon * dlon);
+		if ((i = (int )(range / AIS_RANGE_BUCKET)) >= AIS_RANGE_NBUCKETS)
+			i = AIS_RANGE_NBUCKETS - 1;
+		sp->ranges[i]++;
+		if (range > sp->max_range)
+			sp->max_range = range;
+	}
+}
+
+/*
+ * Estimate the number of distinct vessels seen in this window. For
+ * small counts, linear counting on the empty registers does better.
+ */
+unsigned long
+ais_stats_distinct(struct ais_stats *sp)
+{
+	int i, nzero;
+	double sum, est, m = AIS_HLL_SIZE;
+
+	for (i = nzero = 0, sum = 0.0; i < AIS_HLL_SIZE; i++) {
+		sum += ldexp(1.0, -sp->hll[i]);
+		if (sp->hll[i] == 0)
+			nzero++;
+	}
+	est = 0.7213 / (1.0 + 1.079 / m) * m * m / sum;
+	if (est <= 2.5 * m && nzero > 0)
+		est = m * log(m / nzero);
+	return((unsigned long )(est + 0.5));
+}
+
+/*
+ * Write a one-line summary of the window. Types and ranges with
+ * nothing in them are left out.
+ */
+void
+ais_stats_print(struct ais_stats *sp, FILE *fp)
+{
+	int i, j;
+	char *sep;
+	time_t when = sp->window;
+	struct tm *tmp;
+	struct ais_heavy top[AIS_STATS_TOPK], h;
+
+	tmp = localtime(&when);
+	fprintf(fp, "%04d-%02d-%02d %02d:%02d rx=%s sentences=%lu messages=%lu",
+				tmp->tm_year + 1900, tmp->tm_mon + 1, tmp->tm_mday,
+				tmp->tm_hour, tmp->tm_min, sp->name, sp->nsentences,
+				sp->nmessages);
+	fprintf(fp, " vessels=%lu chanA=%lu chanB=%lu types=", ais_stats_distinct(sp),
+				sp->chans[0], sp->chans[1]);
+	for (i = 0, sep = ""; i < AIS_STATS_NTYPES; i++) {
+		if (sp->types[i] == 0)
+			continue;
+		fprintf(fp, "%s%d:%lu", sep, i, sp->types[i]);
+		sep = ",";
+	}
+	/*
+	 * Busiest first.
+	 */
+	memcpy(top, sp->top, sp->ntop * sizeof(h));
+	for (i = 1; i < sp->ntop; i++) {
+		h = top[i];
+		for (j = i; j > 0 && top[j - 1].count < h.count; j--)
+			top[j] = top[j - 1];
+		top[j] = h;
+	}
+	fprintf(fp, " top=");
+	for (i = 0, sep = ""; i < sp->ntop; i++) {
+		fprintf(fp, "%s%09u:%u", sep, top[i].mmsi, top[i].count);
+		sep = ",";
+	}
+	if (sp->has_position) {
+		fprintf(fp, " maxrange=%.1f range=", sp->max_range);
+		for (i = 0, sep = ""; i < AIS_RANGE_NBUCKETS; i++) {
+			if (sp->ranges[i] == 0)
+				continue;
+			fprintf(fp, "%s%d:%lu", sep, i * AIS_RANGE_BUCKET, sp->ranges[i]);
+			sep = ",";
+		}
+	}
+	fputc('\n', fp);
+}
+
+/*
+ * Mix the bits of an MMSI (the splitmix64 finaliser). MMSIs are
+ * anything but random, so this matters.
+ */
+static unsigned long long
+_hash(unsigned int mmsi)
+{
+	unsigned long long h = mmsi + 0x9e3779b97f4a7c15ULL;
+
+	h = (h ^ (h >> 30)) * 0xbf58476d1ce4e5b9ULL;
+	h = (h ^ (h >> 27)) * 0x94d049bb133111ebULL;
+	return(h ^ (h >> 31));
+}
+
+/*
+ * Count an MMSI in the count-min sketch, and keep the list of the
+ * busiest ones up to date. Each row of the sketch is indexed by a
+ * different mix of two halves of the hash.
+ */
+static void
+_heavy(struct ais_stats *sp, unsigned int mmsi)
+{
+	int i, min;
+	unsigned int h1, h2, est, *cp;
+	unsigned long long h;
+
+	h = _hash(mmsi ^ 0x5bd1e995);
+	h1 = h;
+	h2 = (h >> 32) | 1;
+	est = ~0U;
+	for (i = 0; i < AIS_CMS_DEPTH; i++) {
+		cp = &sp->cms[i][(h1 + i * h2) & (AIS_CMS_WIDTH - 1)];
+		if (++*cp < est)
+			est = *cp;
+	}
+	for (i = min = 0; i < sp->ntop; i++) {
+		if (sp->top[i].mmsi == mmsi) {
+			sp->top[i].count = est;
+			return;
+		}
+		if (sp->top[i].count < sp->top[min].count)
+			min = i;
+	}
+	if (sp->ntop < AIS_STATS_TOPK)
+		min = sp->ntop++;
+	else if (est <= sp->top[min].count)
+		return;
+	sp->top[min].mmsi = mmsi;
+	sp->top[min].count = est;
+}
+
+/*
+ * Make sure a directory (such as the one for a day's logs and stats)
+ * exists, creating any parents as needed. Returns -1 (with errno set)
+ * on failure, including when the path is there but isn't a directory.
+ */
+int
+ais_make_path(char *path)
+{
+	char *cp;
+	struct stat stbuf;
+
+	if (stat(path, &stbuf) >= 0) {
+		if ((stbuf.st_mode & S_IFMT) != S_IFDIR) {
+			errno = ENOTDIR;
+			return(-1);
+		}
+		return(0);
+	}
+	if ((cp = strrchr(path, '/')) != NULL && cp != path) {
+		*cp = '\0';
+		if (ais_make_path(path) < 0) {
+			*cp = '/';
+			return(-1);
+		}
+		*cp = '/';
+	}
+	if (mkdir(path, 0755) < 0 && errno != EEXIST)
+		return(-1);
+	return(0);
+}
@@ -0,0 +1,90 @@
+/*
+ * Copyright (c) 2021, Kalopa Robotics Limited.  All rights reserved.
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. All advertising materials mentioning features or use of this
+ *    software must display the following acknowledgement:
+ *      "This product includes software developed by Kalopa Robotics
+ *      Limited."
+ *
+ * 4. The name of Kalopa Robotics must not be used to endorse or promote
+ *    products derived from this software without specific prior written
+ *    permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY KALOPA ROBOTICS LIMITED "AS IS" AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL KALOPA ROBOTICS LIMITED
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY,
+ * OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * ABSTRACT
+ * Streaming statistics for a receiver, in constant memory. Distinct
+ * vessels are counted with a HyperLogLog, the busiest vessels are
+ * found with a count-min sketch, and there are plain counters for the
+ * message type mix, the two channels and (if we know where the
+ * receiver is) a histogram of range. Everything covers a tumbling
+ * window - the caller decides when it is over, writes the summary out
+ * and starts again.
+ */
+#ifndef _AIS_STATS_H_
+#define _AIS_STATS_H_
+
+#define AIS_HLL_BITS		12
+#define AIS_HLL_SIZE		(1 << AIS_HLL_BITS)
+#define AIS_CMS_DEPTH		4
+#define AIS_CMS_WIDTH		2048
+#define AIS_STATS_TOPK		10
+#define AIS_STATS_NTYPES	28
+#define AIS_RANGE_NBUCKETS	20
+#define AIS_RANGE_BUCKET	10
+#define AIS_STATS_WINDOW	3600
+#define AIS_STATS_NAMELEN	64
+
+struct ais_heavy {
+	unsigned int	mmsi;
+	unsigned int	count;
+};
+
+struct ais_stats {
+	char				name[AIS_STATS_NAMELEN];
+	long				window;
+	unsigned long		nsentences;
+	unsigned long		nmessages;
+	unsigned long		types[AIS_STATS_NTYPES];
+	unsigned long		chans[2];
+	int					has_position;
+	int					lat;
+	int					lon;
+	unsigned long		ranges[AIS_RANGE_NBUCKETS];
+	double				max_range;
+	int					ntop;
+	struct ais_heavy	top[AIS_STATS_TOPK];
+	unsigned char		hll[AIS_HLL_SIZE];
+	unsigned int		cms[AIS_CMS_DEPTH][AIS_CMS_WIDTH];
+};
+
+void			ais_stats_init(struct ais_stats *, char *, long);
+void			ais_stats_position(struct ais_stats *, int, int);
+void			ais_stats_reset(struct ais_stats *, long);
+void			ais_stats_sentence(struct ais_stats *);
+void			ais_stats_record(struct ais_stats *, struct ais_record *);
+unsigned long	ais_stats_distinct(struct ais_stats *);
+void			ais_stats_print(struct ais_stats *, FILE *);
+int				ais_make_path(char *);
+
+#endif /* _AIS_STATS_H_ */
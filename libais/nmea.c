@@ -0,0 +1,496 @@
+/*
+ * Copyright (c) 2021, Kalopa Robotics Limited.  All rights reserved.
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. All advertising materials mentioning features or use of this
+ *    software must display the following acknowledgement:
+ *      "This product includes software developed by Kalopa Robotics
+ *      Limited."
+ *
+ * 4. The name of Kalopa Robotics must not be used to endorse or promote
+ *    products derived from this software without specific prior written
+ *    permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY KALOPA ROBOTICS LIMITED "AS IS" AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL KALOPA ROBOTICS LIMITED
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY,
+ * OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * ABSTRACT
+ * NMEA sentence handling. Break an incoming byte stream into lines,
+ * validate each one as an AIS sentence, and reassemble multi-sentence
+ * messages before handing them off to be decoded.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+
+#include "ais.h"
+
+static void	_append(struct nmea_parser *, const char *, int);
+static void	_endline(struct nmea_parser *);
+static int	_reassemble(struct nmea_parser *, int, int, char *, int);
+
+/*
+ * The talker IDs which can legitimately carry AIS data.
+ */
+static const char *ais_talkers[] = {
+	"AB", "AD", "AI", "AN", "AR", "AS", "AT", "AX", "BS", "SA", NULL
+};
+
+/*
+ * Set up a parser. Either callback can be NULL. If there's no message
+ * callback then sentences are validated but never decoded.
+ */
+void
+nmea_init(struct nmea_parser *pp,
+			void (*sentence_cb)(void *, char *, int),
+			void (*message_cb)(void *, struct ais_msg *, struct ais_record *),
+			void *arg)
+{
+	memset(pp, 0, sizeof(*pp));
+	pp->sentence_cb = sentence_cb;
+	pp->message_cb = message_cb;
+	pp->cb_arg = arg;
+}
+
+/*
+ * Push some raw bytes into the parser. Complete lines are processed
+ * immediately, and a partial line is held over for the next call.
+ */
+void
+nmea_feed(struct nmea_parser *pp, const char *datap, int len)
+{
+	const char *cp, *endp;
+
+	for (endp = datap + len; datap < endp; datap = cp + 1) {
+		if ((cp = memchr(datap, '\n', endp - datap)) == NULL) {
+			_append(pp, datap, endp - datap);
+			return;
+		}
+		_append(pp, datap, cp - datap);
+		_endline(pp);
+	}
+}
+
+/*
+ * Stamp the bytes about to be fed in with the time they arrived.
+ */
+void
+nmea_stamp(struct nmea_parser *pp, long long rt_usec, long long mono_usec)
+{
+	pp->feed_rt = rt_usec;
+	pp->feed_mono = mono_usec;
+}
+
+/*
+ * Process any partial line as if it had been terminated. Useful at the
+ * end of a datagram, or of a file.
+ */
+void
+nmea_flush(struct nmea_parser *pp)
+{
+	_endline(pp);
+}
+
+/*
+ * Add some bytes to the current line. If the line is too long then
+ * ignore the rest of it. The first bytes of a line stamp it.
+ */
+static void
+_append(struct nmea_parser *pp, const char *datap, int len)
+{
+	if (pp->discard || len == 0)
+		return;
+	if (pp->offset == 0) {
+		pp->line_rt = pp->feed_rt;
+		pp->line_mono = pp->feed_mono;
+	}
+	if (pp->offset + len > NMEA_MAXLINE) {
+		pp->noverflow++;
+		pp->discard = 1;
+		pp->offset = 0;
+		return;
+	}
+	memcpy(pp->line + pp->offset, datap, len);
+	pp->offset += len;
+}
+
+/*
+ *
+ */
+static void
+_endline(struct nmea_parser *pp)
+{
+	if (!pp->discard && pp->offset > 0) {
+		while (pp->offset > 0 && (pp->line[pp->offset - 1] == '\r' ||
+								pp->line[pp->offset - 1] == '\0'))
+			pp->offset--;
+		pp->line[pp->offset] = '\0';
+		if (pp->offset > 0)
+			nmea_sentence(pp, pp->line);
+	}
+	pp->offset = 0;
+	pp->discard = 0;
+}
+
+/*
+ * Compute the NMEA checksum of a string, up to the '*' or the end of
+ * the string. The end pointer is left pointing at whichever it was.
+ */
+int
+nmea_checksum(const char *strp, const char **endpp)
+{
+	int csum;
+
+	for (csum = 0; *strp != '*' && *strp != '\0'; strp++)
+		csum ^= *strp;
+	if (endpp != NULL)
+		*endpp = strp;
+	return(csum);
+}
+
+/*
+ * Parse a TAG block at the start of a line. Returns the length of the
+ * block (including both backslashes), zero if there isn't one, or -1
+ * if it's broken. Fields we don't know about are skipped.
+ */
+int
+nmea_tag_parse(const char *linep, struct nmea_tag *tp)
+{
+	int i, n, msecs;
+	char *argv[NMEA_MAXARGS], fields[NMEA_TAG_MAXLEN * 2];
+	const char *cp, *endp;
+
+	tp->flags = 0;
+	msecs = 0;
+	if (*linep != '\\')
+		return(0);
+	if ((endp = strchr(linep + 1, '\\')) == NULL ||
+				endp - linep > (int )sizeof(fields) - 1)
+		return(-1);
+	n = nmea_checksum(linep + 1, &cp);
+	if (cp > endp || cp + 3 != endp || !isxdigit(cp[1]) || !isxdigit(cp[2]) ||
+				to_int((char *)cp + 1, 16) != n)
+		return(-1);
+	n = cp - (linep + 1);
+	memcpy(fields, linep + 1, n);
+	fields[n] = '\0';
+	/*
+	 * crack() says one more than it has room for if it ran out, and
+	 * no sane TAG block has that many fields.
+	 */
+	if ((n = crack(fields, argv, NMEA_MAXARGS)) > NMEA_MAXARGS)
+		return(-1);
+	for (i = 0; i < n; i++) {
+		if (argv[i] == NULL || argv[i][0] == '\0' || argv[i][1] != ':')
+			continue;
+		switch (argv[i][0]) {
+		case 's':
+			strncpy(tp->src, argv[i] + 2, NMEA_TAG_SRCLEN - 1);
+			tp->src[NMEA_TAG_SRCLEN - 1] = '\0';
+			tp->flags |= NMEA_TAG_SRC;
+			break;
+
+		case 'n':
+			tp->seq = strtoul(argv[i] + 2, NULL, 10);
+			tp->flags |= NMEA_TAG_SEQ;
+			break;
+
+		case 'c':
+			/*
+			 * Seconds, as per the standard, or milliseconds as
+			 * plenty of kit sends.
+			 */
+			if ((tp->time_ms = strtoll(argv[i] + 2, NULL, 10)) < 100000000000LL)
+				tp->time_ms *= 1000;
+			tp->flags |= NMEA_TAG_TIME;
+			break;
+
+		case 'm':
+			if ((msecs = atoi(argv[i] + 2)) < 0 || msecs > 999)
+				msecs = 0;
+			break;
+		}
+	}
+	/*
+	 * The milliseconds only mean anything on top of whole seconds.
+	 */
+	if ((tp->flags & NMEA_TAG_TIME) && tp->time_ms % 1000 == 0)
+		tp->time_ms += msecs;
+	return(endp + 1 - linep);
+}
+
+/*
+ * Build a TAG block with a source, sequence number and a time given in
+ * milliseconds. The time goes out as standard seconds in "c:", and the
+ * milliseconds in "m:". Returns the length, or -1 if it doesn't fit.
+ */
+int
+nmea_tag_build(char *bufp, int buflen, const char *src, unsigned long seq, long long time_ms)
+{
+	int n;
+
+	n = snprintf(bufp, buflen, "\\s:%s,n:%lu,c:%lld,m:%03d", src, seq,
+					time_ms / 1000, (int )(time_ms % 1000));
+	if (n < 0 || n + 5 > buflen)
+		return(-1);
+	n += sprintf(bufp + n, "*%02X\\", nmea_checksum(bufp + 1, NULL));
+	return(n);
+}
+
+/*
+ * Deal with a single line of NMEA data (without any line terminator).
+ * Returns zero if it was a valid AIS sentence, or -1 if not. The line
+ * itself isn't modified. Any TAG block in front of the sentence is
+ * taken off and left in pp->tag for the callbacks to look at.
+ */
+int
+nmea_sentence(struct nmea_parser *pp, char *linep)
+{
+	int i, n, type, nfrags, frag_no, msg_id, chan, fill;
+	char *strp, *argv[NMEA_MAXARGS], fields[NMEA_MAXLINE + 1];
+	const char *cp;
+
+	pp->nlines++;
+	if ((n = nmea_tag_parse(linep, &pp->tag)) < 0) {
+		pp->nbadtag++;
+		return(-1);
+	}
+	if (n > 0) {
+		pp->ntagged++;
+		linep += n;
+	}
+	if (*linep != '!')
+		return(-1);
+	/*
+	 * Compute and verify the checksum.
+	 */
+	n = nmea_checksum(linep + 1, &cp);
+	if (*cp != '*' || !isxdigit(cp[1]) || !isxdigit(cp[2]) || to_int((char *)cp + 1, 16) != n) {
+		pp->nbadcsum++;
+		return(-1);
+	}
+	/*
+	 * Quick check that it's an AIS NMEA string, and look to see if it's
+	 * ..VDM or ..VDO - don't care about anything else.
+	 */
+	strp = linep + 1;
+	for (i = 0; ais_talkers[i] != NULL; i++)
+		if (strncmp(strp, ais_talkers[i], 2) == 0)
+			break;
+	if (ais_talkers[i] == NULL)
+		return(-1);
+	strp += 2;
+	if (strncmp(strp, "VDM,", 4) == 0)
+		type = MSGTYPE_VDM;
+	else {
+		if (strncmp(strp, "VDO,", 4) == 0)
+			type = MSGTYPE_VDO;
+		else
+			return(-1);
+	}
+	strp += 4;
+	pp->nsentences++;
+	if (pp->sentence_cb != NULL)
+		pp->sentence_cb(pp->cb_arg, linep, strlen(linep));
+	if (pp->message_cb == NULL)
+		return(0);
+	/*
+	 * Now, process the remaining arguments by cracking apart a copy of
+	 * the comma-separated values.
+	 */
+	n = cp - strp;
+	memcpy(fields, strp, n);
+	fields[n] = '\0';
+	n = crack(fields, argv, NMEA_MAXARGS);
+	if (n != 6 ||
+				(nfrags = to_int(argv[0], 10)) < 1 ||
+				(frag_no = to_int(argv[1], 10)) < 1 || frag_no > nfrags ||
+				(msg_id = to_int(argv[2], 10)) < 0 ||
+				(fill = to_int(argv[5], 10)) < 0 || fill > 5) {
+		pp->nerrors++;
+		return(-1);
+	}
+	if (*argv[3] == 'B' || *argv[3] == '2')
+		chan = 1;
+	else
+		chan = 0;
+	pp->msg.raw_src = linep;
+	pp->msg.type = type;
+	pp->msg.chan = chan;
+	pp->msg.msg_id = msg_id;
+	pp->msg.nfrags = nfrags;
+	if (nfrags == 1)
+		n = ais_armour(&pp->msg, argv[4], strlen(argv[4]), fill);
+	else {
+		if ((n = _reassemble(pp, frag_no, chan, argv[4], msg_id)) > 0)
+			return(0);
+		if (n == 0) {
+			struct nmea_slot *sp = &pp->slots[pp->next_slot];
+
+			n = ais_armour(&pp->msg, sp->armour, sp->armour_len, fill);
+			sp->in_use = 0;
+		}
+	}
+	if (n < 0 || ais_decode(&pp->msg, &pp->rec) < 0) {
+		pp->nerrors++;
+		return(-1);
+	}
+	pp->nmessages++;
+	pp->message_cb(pp->cb_arg, &pp->msg, &pp->rec);
+	return(0);
+}
+
+/*
+ * Add a fragment of a multi-sentence message to its reassembly slot.
+ * Returns 1 if there's more to come, 0 if the message is complete (in
+ * which case next_slot is the slot holding it) and -1 on error.
+ */
+static int
+_reassemble(struct nmea_parser *pp, int frag_no, int chan, char *armour, int msg_id)
+{
+	int i, len;
+	struct nmea_slot *sp;
+
+	for (i = 0, sp = pp->slots; i < NMEA_NSLOTS; i++, sp++)
+		if (sp->in_use && sp->chan == chan && sp->msg_id == msg_id)
+			break;
+	if (frag_no == 1) {
+		/*
+		 * Start of a new message. Reuse the slot if this ID was
+		 * already in progress, otherwise take a free one, or the
+		 * oldest if they're all busy.
+		 */
+		if (i == NMEA_NSLOTS) {
+			for (i = 0, sp = pp->slots; i < NMEA_NSLOTS; i++, sp++)
+				if (!sp->in_use)
+					break;
+			if (i == NMEA_NSLOTS) {
+				i = pp->next_slot;
+				pp->next_slot = (pp->next_slot + 1) % NMEA_NSLOTS;
+				sp = &pp->slots[i];
+			}
+		}
+		sp->in_use = 1;
+		sp->chan = chan;
+		sp->msg_id = msg_id;
+		sp->nfrags = pp->msg.nfrags;
+		sp->next_frag = 1;
+		sp->armour_len = 0;
+	} else if (i == NMEA_NSLOTS)
+		return(-1);
+	if (frag_no != sp->next_frag || sp->nfrags != pp->msg.nfrags ||
+				sp->armour_len + (len = strlen(armour)) > AIS_MAXARMOUR) {
+		sp->in_use = 0;
+		return(-1);
+	}
+	memcpy(sp->armour + sp->armour_len, armour, len);
+	sp->armour_len += len;
+	if (++sp->next_frag <= sp->nfrags)
+		return(1);
+	pp->next_slot = i;
+	return(0);
+}
+
+/*
+ * Convert a line from one of the hourly logs ("HH:MM:SS:AIVDM,...")
+ * back into the sentence it came from. The seconds can have a
+ * fraction ("HH:MM:SS.ffffff:"), which is ignored. The log drops the
+ * leading '!' and the checksum, so put both of them back. Returns the
+ * time of day in seconds, or -1 if the line doesn't look right.
+ */
+int
+nmea_logline(const char *linep, char *sentp, int maxlen)
+{
+	int hh, mm, ss, n, len;
+	const char *cp;
+
+	if (sscanf(linep, "%2d:%2d:%2d%n", &hh, &mm, &ss, &n) != 3 ||
+					hh > 23 || mm > 59 || ss > 60)
+		return(-1);
+	linep += n;
+	if (*linep == '.')
+		for (linep++; isdigit(*linep); linep++)
+			;
+	if (*linep++ != ':')
+		return(-1);
+	if ((cp = strpbrk(linep, "\r\n")) == NULL)
+		cp = linep + strlen(linep);
+	if ((len = cp - linep) == 0 || len + 6 > maxlen)
+		return(-1);
+	*sentp = '!';
+	memcpy(sentp + 1, linep, len);
+	sentp[len + 1] = '\0';
+	sprintf(sentp + len + 1, "*%02X", nmea_checksum(sentp + 1, NULL));
+	return(hh * 3600 + mm * 60 + ss);
+}
+
+/*
+ * Break a comma-separated string into its component fields.
+ */
+int
+crack(char *strp, char *argv[], int maxargs)
+{
+	int i;
+
+	for (i = 0; i < maxargs; i++) {
+		while (strp != NULL && isspace(*strp))
+			strp++;
+		argv[i] = strp;
+		if (strp == NULL || *strp == '\0')
+			break;
+		while (*strp != '\0' && *strp != ',')
+			strp++;
+		if (*strp == '\0')
+			break;
+		*strp++ = '\0';
+	}
+	return(i + 1);
+}
+
+/*
+ *
+ */
+int
+to_int(char *strp, int base)
+{
+	int val, ch;
+
+	for (val = 0; isxdigit(*strp);) {
+		ch = *strp++;
+		if (isdigit(ch))
+			ch -= '0';
+		else {
+			if (ch >= 'A' && ch <= 'F')
+				ch = (ch - 'A') + 10;
+			else {
+				if (ch >= 'a' && ch <= 'f')
+					ch = (ch - 'a') + 10;
+				else
+					return(-1);
+			}
+		}
+		if (ch >= base)
+			return(-1);
+		val = val * base + ch;
+	}
+	return(val);
+}